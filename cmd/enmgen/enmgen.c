@@ -3,23 +3,14 @@
 #include "../../include/mid.h"
 #include "../../include/log.h"
 #include "../../include/rng.h"
+#include "../../include/gen.h"
 #include <time.h>
 #include <stdlib.h>
+#include <string.h>
 #include <limits.h>
 
-enum { Startx = 2, Starty = 2 };
-
-typedef struct Loc {
-	Point p;
-	int z;
-} Loc;
-
-extern _Bool enemyinit(Enemy *, EnemyID id, int x, int y);
 static int rng(Rng *, int, char *[]);
-static int rmz(Loc [], int nls, int z);
 static int idargs(int argc, char *argv[], int **ids);
-static int locs(Zone *, Loc []);
-static _Bool goodloc(Zone *, int, Point);
 
 int main(int argc, char *argv[])
 {
@@ -27,6 +18,13 @@ int main(int argc, char *argv[])
 
 	loginit(NULL);
 
+	int bin = 0;
+	if (argc > 1 && strcmp(argv[1], "-b") == 0) {
+		bin = 1;
+		argc--;
+		argv++;
+	}
+
 	Rng r;
 	int usdargs = rng(&r, argc, argv);
 	argc -= usdargs;
@@ -35,41 +33,22 @@ int main(int argc, char *argv[])
 	int n = idargs(argc, argv, &ids);
 
 	if (argc < 3)
-		fatal("usage: enmgen [-s <seed>] <ID>+ <num>");
+		fatal("usage: enmgen [-b] [-s <seed>] <ID>+ <num>");
 
 	long num = strtol(argv[argc-1], NULL, 10);
 	if (num == LONG_MIN || num == LONG_MAX)
-			fatal("Invalid number: %s", argv[argc-1]);
+		fatal("Invalid number: %s", argv[argc-1]);
 
-	Zone *zn = zoneread(stdin);
-	if (!zn)
+	Zstrm *zs = zstrmread(stdin, stdout);
+	if (!zs)
 		die("Failed to read the zone: %s", miderrstr());
+	Zone *zn = zs->zn;
 
-	Loc ls[zn->lvl->d * zn->lvl->w * zn->lvl->h];
-	int nls = locs(zn, ls);
-
-	int i;
-	for (i = 0; i < num && nls > 0; i++) {
-		int idind = rngintincl(&r, 0, n);
-		int lind = rngintincl(&r, 0, nls);
-		Loc l = ls[lind];
-		if (nls > 1)
-			ls[lind] = ls[nls-1];
-		nls--;
-		Enemy enm;
-		if (!enemyinit(&enm, ids[idind], l.p.x, l.p.y))
-			fatal("Failed to initialize enemy with ID: %d", ids[idind]);
-		if (!zoneaddenemy(zn, l.z, enm)) {
-			nls = rmz(ls, nls, l.z);
-			num--;
-		}
-	}
-
-	if (i < num)
-		fatal("Failed to place all items");
+	if (!enmgen(&r, zn, ids, n, num))
+		fatal("%s", miderrstr());
 
-	zonewrite(stdout, zn);
-	zonefree(zn);
+	zstrmwrite(zs, stdout, bin ? zonewriteb : zonewrite);
+	zstrmfree(zs);
 	xfree(ids);
 
 	return 0;
@@ -106,42 +85,3 @@ static int idargs(int argc, char *argv[], int *ids[])
 
 	return i-1;
 }
-
-static int locs(Zone *zn, Loc locs[])
-{
-	int nxt = 0;
-	for (int z = 0; z < zn->lvl->d; z++) {
-		int sz = zn->lvl->w * zn->lvl->h;
-		Point pts[sz];
-		int npts = zonelocs(zn, z, goodloc, pts, sz);
-		for (int i = 0; i < npts; i++) {
-			locs[nxt] = (Loc) { pts[i], z };
-			nxt++;
-		}
-	}
-	return nxt;
-}
-
-static _Bool goodloc(Zone *zn, int z, Point pt)
-{
-	int doorrad = 2;
-	return (pt.x != Startx || pt.y != Starty)
-		&& !zonehasflags(zn, z, pt, (Point) { Twidth, Theight }, Tcollide)
-		&& !zonehasflags(zn, z, (Point) { pt.x - doorrad, pt.y },
-			(Point) { 2 * doorrad * Twidth, Theight },
-			Tfdoor | Tbdoor | Tup)
-		&& zoneongrnd(zn, z, pt, (Point) { Twidth, Theight })
-		&& !zoneoverlap(zn, z, pt, (Point) { Twidth, Theight });
-}
-
-static int rmz(Loc ls[], int nls, int z)
-{
-	for (int i = 0; i < nls; i++) {
-		if (ls[i].z != z)
-			continue;
-		ls[i] = ls[nls-1];
-		nls--;
-	}
-
-	return nls;
-}
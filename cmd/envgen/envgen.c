@@ -3,25 +3,14 @@
 #include "../../include/mid.h"
 #include "../../include/log.h"
 #include "../../include/rng.h"
+#include "../../include/gen.h"
 #include <time.h>
 #include <stdlib.h>
+#include <string.h>
 #include <limits.h>
 
-enum { Startx = 2, Starty = 2 };
-
-typedef struct Loc {
-	Point p;
-	int z;
-} Loc;
-
-Point wh;
-Rect start;
-
 static int rng(Rng *, int, char *[]);
-static int rmz(Loc [], int nls, int z);
 static int idargs(int argc, char *argv[], int **ids);
-static int locs(Zone *, Loc []);
-static _Bool goodloc(Zone *, int, Point);
 
 int main(int argc, char *argv[])
 {
@@ -29,6 +18,13 @@ int main(int argc, char *argv[])
 
 	loginit(NULL);
 
+	int bin = 0;
+	if (argc > 1 && strcmp(argv[1], "-b") == 0) {
+		bin = 1;
+		argc--;
+		argv++;
+	}
+
 	Rng r;
 	int usdargs = rng(&r, argc, argv);
 	argc -= usdargs;
@@ -37,48 +33,22 @@ int main(int argc, char *argv[])
 	int n = idargs(argc, argv, &ids);
 
 	if (argc < 3)
-		fatal("%d  usage: envgen <ID>+ <num>", argc);
+		fatal("%d  usage: envgen [-b] <ID>+ <num>", argc);
 
 	long num = strtol(argv[argc-1], NULL, 10);
 	if (num == LONG_MIN || num == LONG_MAX)
 		fatal("Invalid number: %s", argv[argc-1]);
 
-	start = (Rect) { (Point) { Startx * Twidth, Starty * Theight },
-		(Point) { (Startx+1) * Twidth, (Starty+1) * Theight } };
-
-	Zone *zn = zoneread(stdin);
-	if (!zn)
+	Zstrm *zs = zstrmread(stdin, stdout);
+	if (!zs)
 		die("Failed to read the zone: %s", miderrstr());
+	Zone *zn = zs->zn;
 
-	Loc ls[zn->lvl->d * zn->lvl->w * zn->lvl->h];
+	if (!envgen(&r, zn, ids, n, num))
+		fatal("%s", miderrstr());
 
-	int i;
-	for (i = 0; i < num; i++) {
-		int id = ids[rngintincl(&r, 0, n)];
-		wh = envsize(id);
-		int nls = locs(zn, ls);
-		if (nls == 0)
-			fatal("No location available to place env ID: %d\n", id);
-
-		int lind = rngintincl(&r, 0, nls);
-		Loc l = ls[lind];
-		if (nls > 1)
-			ls[lind] = ls[nls-1];
-		nls--;
-		Env env;
-		if (!envinit(&env, id, l.p))
-			fatal("Failed to initialize env with ID: %d", id);
-		if (!zoneaddenv(zn, l.z, env)) {
-			rmz(ls, nls, l.z);
-			num--;
-		}
-	}
-
-	if (i < num)
-		fatal("Failed to place all items");
-
-	zonewrite(stdout, zn);
-	zonefree(zn);
+	zstrmwrite(zs, stdout, bin ? zonewriteb : zonewrite);
+	zstrmfree(zs);
 	xfree(ids);
 
 	return 0;
@@ -115,40 +85,3 @@ static int idargs(int argc, char *argv[], int *ids[])
 
 	return i-1;
 }
-
-static int locs(Zone *zn, Loc locs[])
-{
-	int nxt = 0;
-	for (int z = 0; z < zn->lvl->d; z++) {
-		int sz = zn->lvl->w * zn->lvl->h;
-		Point pts[sz];
-		int npts = zonelocs(zn, z, goodloc, pts, sz);
-		for (int i = 0; i < npts; i++) {
-			locs[nxt] = (Loc) { pts[i], z };
-			nxt++;
-		}
-	}
-	return nxt;
-}
-
-static _Bool goodloc(Zone *zn, int z, Point pt)
-{
-	Rect r = (Rect) { (Point) { pt.x * Twidth, pt.y * Theight },
-		(Point) { pt.x * Twidth + wh.x, pt.y * Theight + wh.y } };
-	return !isect(start, r)
-		&& !zonehasflags(zn, z, pt, wh, Tcollide | Tbdoor | Tfdoor | Tdown)
-		&& zoneongrnd(zn, z, pt, wh)
-		&& !zoneoverlap(zn, z, pt, wh);
-}
-
-static int rmz(Loc ls[], int nls, int z)
-{
-	for (int i = 0; i < nls; i++) {
-		if (ls[i].z != z)
-			continue;
-		ls[i] = ls[nls-1];
-		nls--;
-	}
-
-	return nls;
-}
@@ -4,14 +4,11 @@
 #include "../../include/log.h"
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
 
 enum { Startx = 2, Starty = 2 };
 
-static _Bool goodloc(Zone *zn, int z, Point pt);
-static int cmp(const void*, const void*);
-
-Point wh;
-Rect start;
+static _Bool goodloc(Zone *zn, int z, Point pt, Point wh);
 
 int main(int argc, char *argv[])
 {
@@ -19,42 +16,64 @@ int main(int argc, char *argv[])
 
 	loginit(NULL);
 
+	int bin = 0;
+	if (argc > 1 && strcmp(argv[1], "-b") == 0) {
+		bin = 1;
+		argc--;
+		argv++;
+	}
+
 	if (argc < 2 || argc > 3)
-		fatal("usage: envnear <env ID> [<num>]");
+		fatal("usage: envnear [-b] <env ID> [<num>]");
 
 	id = strtol(argv[1], NULL, 10);
 	if (argc == 3)
 		num = strtol(argv[2], NULL, 10);
+	if (num < 1)
+		fatal("Invalid number: %s", argv[2]);
 
-	Zone *zn = zoneread(stdin);
-	if (!zn)
+	Zstrm *zs = zstrmread(stdin, stdout);
+	if (!zs)
 		die("Failed to read the zone: %s", miderrstr());
+	Zone *zn = zs->zn;
 
-	wh = envsize(id);
-	start = (Rect) { (Point) { Startx * Twidth, Starty * Theight },
-		(Point) { (Startx+1) * Twidth, (Starty+1) * Theight } };
-
-	int sz = zn->lvl->w * zn->lvl->h;
-	Point pts[sz];
-	int n = zonelocs(zn, 0, goodloc, pts, sz);
+	Cands *cs = candsnew(zn, 0, zn->lvl->d, envsize(id), goodloc);
+	Cand *near = xalloc(num, sizeof(*near));
+	int n = candsnear(cs, near, num);
 	if (!n)
 		fatal("No locations available to place env ID: %d\n", id);
 
-	qsort(pts, n, sizeof(*pts), cmp);
-	for (int i = 0; i < num; i++) {
-		Env env;
-		if (!envinit(&env, id, pts[i]))
-			fatal("Failed to initialize env with ID: %d", id);
-		zoneaddenv(zn, 0, env);
+	// Candidates that are taken by the earlier placements are
+	// skipped, and the next nearest are selected once the batch
+	// is used up.
+	while (n > 0 && num > 0) {
+		for (int i = 0; i < n && num > 0; i++) {
+			if (!candshas(cs, near[i]))
+				continue;
+			Env env;
+			if (!envinit(&env, id, near[i].pt))
+				fatal("Failed to initialize env with ID: %d", id);
+			if (!zoneaddenv(zn, near[i].z, env)) {
+				candsrmz(cs, near[i].z);
+				continue;
+			}
+			candsupdate(cs, near[i].z, env.body.bbox);
+			num--;
+		}
+		n = num > 0 ? candsnear(cs, near, num) : 0;
 	}
 
-	zonewrite(stdout, zn);
-	zonefree(zn);
+	zstrmwrite(zs, stdout, bin ? zonewriteb : zonewrite);
+	candsfree(cs);
+	xfree(near);
+	zstrmfree(zs);
 	return 0;
 }
 
-static _Bool goodloc(Zone *zn, int z, Point pt)
+static _Bool goodloc(Zone *zn, int z, Point pt, Point wh)
 {
+	Rect start = (Rect) { (Point) { Startx * Twidth, Starty * Theight },
+		(Point) { (Startx+1) * Twidth, (Starty+1) * Theight } };
 	Rect r = (Rect) { (Point) { pt.x * Twidth, pt.y * Theight },
 		(Point) { pt.x * Twidth + wh.x, pt.y * Theight + wh.y } };
 	return !isect(start, r)
@@ -62,18 +81,3 @@ static _Bool goodloc(Zone *zn, int z, Point pt)
 		&& zoneongrnd(zn, z, pt, wh)
 		&& !zoneoverlap(zn, z, pt, wh);
 }
-
-static int cmp(const void *_a, const void *_b)
-{
-	const Point *a = (const Point*) _a;
-	const Point *b = (const Point*) _b;
-
-	double da = ptsqdist(*a, (Point){Startx, Starty});
-	double db = ptsqdist(*b, (Point){Startx, Starty});
-
-	if (da < db)
-		return -1;
-	else if (da > db)
-		return 1;
-	return 0;
-}
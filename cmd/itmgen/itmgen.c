@@ -3,22 +3,14 @@
 #include "../../include/mid.h"
 #include "../../include/log.h"
 #include "../../include/rng.h"
+#include "../../include/gen.h"
 #include <time.h>
 #include <stdlib.h>
+#include <string.h>
 #include <limits.h>
 
-enum { Startx = 2, Starty = 2 };
-
-typedef struct Loc {
-	Point p;
-	int z;
-} Loc;
-
 static int rng(Rng *, int, char *[]);
-static int rmz(Loc [], int nls, int z);
 static int idargs(int argc, char *argv[], int **ids);
-static int locs(Zone *, Loc []);
-static _Bool goodloc(Zone *, int, Point);
 
 int main(int argc, char *argv[])
 {
@@ -26,6 +18,13 @@ int main(int argc, char *argv[])
 
 	loginit(NULL);
 
+	int bin = 0;
+	if (argc > 1 && strcmp(argv[1], "-b") == 0) {
+		bin = 1;
+		argc--;
+		argv++;
+	}
+
 	Rng r;
 	int usdargs = rng(&r, argc, argv);
 	argc -= usdargs;
@@ -34,42 +33,22 @@ int main(int argc, char *argv[])
 	int n = idargs(argc, argv, &ids);
 
 	if (argc < 3)
-		fatal("usage: itmgen [-s <seed>] <ID>+ <num>");
+		fatal("usage: itmgen [-b] [-s <seed>] <ID>+ <num>");
 
 	long num = strtol(argv[argc-1], NULL, 10);
 	if (num == LONG_MIN || num == LONG_MAX)
-			fatal("Invalid number: %s", argv[argc-1]);
+		fatal("Invalid number: %s", argv[argc-1]);
 
-	Zone *zn = zoneread(stdin);
-	if (!zn)
+	Zstrm *zs = zstrmread(stdin, stdout);
+	if (!zs)
 		die("Failed to read the zone: %s", miderrstr());
+	Zone *zn = zs->zn;
 
-	Loc ls[zn->lvl->d * zn->lvl->w * zn->lvl->h];
-	int nls = locs(zn, ls);
-
-	int i;
-	for (i = 0; i < num && nls > 0; i++) {
-		int idind = rngintincl(&r, 0, n);
-		int lind = rngintincl(&r, 0, nls);
-		Loc l = ls[lind];
-		if (nls > 1)
-			ls[lind] = ls[nls-1];
-		nls--;
-		Item it;
-		if (!iteminit(&it, ids[idind], l.p))
-			fatal("Failed to initialize item with ID: %d", ids[idind]);
-		if (!zoneadditem(zn, l.z, it)) {
-			/* oops, this z-layer is full. */
-			nls = rmz(ls, nls, l.z);
-			num--;
-		}
-	}
-
-	if (i < num)
-		fatal("Failed to place all items");
+	if (!itmgen(&r, zn, ids, n, num))
+		fatal("%s", miderrstr());
 
-	zonewrite(stdout, zn);
-	zonefree(zn);
+	zstrmwrite(zs, stdout, bin ? zonewriteb : zonewrite);
+	zstrmfree(zs);
 	xfree(ids);
 
 	return 0;
@@ -106,38 +85,3 @@ static int idargs(int argc, char *argv[], int *ids[])
 
 	return i-1;
 }
-
-static int locs(Zone *zn, Loc locs[])
-{
-	int nxt = 0;
-	for (int z = 0; z < zn->lvl->d; z++) {
-		int sz = zn->lvl->w * zn->lvl->h;
-		Point pts[sz];
-		int npts = zonelocs(zn, z, goodloc, pts, sz);
-		for (int i = 0; i < npts; i++) {
-			locs[nxt] = (Loc) { pts[i], z };
-			nxt++;
-		}
-	}
-	return nxt;
-}
-
-static _Bool goodloc(Zone *zn, int z, Point pt)
-{
-	return (pt.x != Startx || pt.y != Starty)
-		&& zoneongrnd(zn, z, pt, (Point) { Twidth, Theight })
-		&& !zonehasflags(zn, z, pt, (Point) { Twidth, Theight }, Tcollide)
-		&& !zoneoverlap(zn, z, pt, (Point) { Twidth, Theight });
-}
-
-static int rmz(Loc ls[], int nls, int z)
-{
-	for (int i = 0; i < nls; i++) {
-		if (ls[i].z != z)
-			continue;
-		ls[i] = ls[nls-1];
-		nls--;
-	}
-
-	return nls;
-}
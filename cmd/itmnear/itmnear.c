@@ -3,11 +3,11 @@
 #include "../../include/mid.h"
 #include "../../include/log.h"
 #include <stdlib.h>
+#include <string.h>
 
 enum { Startx = 2, Starty = 2 };
 
-static _Bool goodloc(Zone *, int, Point);
-static int cmp(const void*, const void*);
+static _Bool goodloc(Zone *, int, Point, Point);
 
 int main(int argc, char *argv[])
 {
@@ -15,54 +15,63 @@ int main(int argc, char *argv[])
 
 	loginit(NULL);
 
+	int bin = 0;
+	if (argc > 1 && strcmp(argv[1], "-b") == 0) {
+		bin = 1;
+		argc--;
+		argv++;
+	}
+
 	if (argc < 2 || argc > 3)
-		fatal("usage: itmnear <item ID> [<num>]");
+		fatal("usage: itmnear [-b] <item ID> [<num>]");
 	id = strtol(argv[1], NULL, 10);
 	if (argc == 3)
 		num = strtol(argv[2], NULL, 10);
+	if (num < 1)
+		fatal("Invalid number: %s", argv[2]);
 
-	Zone *zn = zoneread(stdin);
-	if (!zn)
+	Zstrm *zs = zstrmread(stdin, stdout);
+	if (!zs)
 		die("Failed to read the zone: %s", miderrstr());
+	Zone *zn = zs->zn;
 
-	int sz = zn->lvl->w * zn->lvl->h;
-	Point pts[sz];
-	int n = zonelocs(zn, 0, goodloc, pts, sz);
+	Cands *cs = candsnew(zn, 0, zn->lvl->d, (Point) { Twidth, Theight }, goodloc);
+	Cand *near = xalloc(num, sizeof(*near));
+	int n = candsnear(cs, near, num);
 	if (!n)
 		fatal("No available locations for item ID %d", id);
 
-	qsort(pts, n, sizeof(*pts), cmp);
-	for (int i = 0; i < num; i++) {
-		Item it;
-		if (!iteminit(&it, id, pts[i]))
-			fatal("Failed to initialize item with ID: %d", id);
-		zoneadditem(zn, 0, it);
+	// Candidates that are taken by the earlier placements are
+	// skipped, and the next nearest are selected once the batch
+	// is used up.
+	while (n > 0 && num > 0) {
+		for (int i = 0; i < n && num > 0; i++) {
+			if (!candshas(cs, near[i]))
+				continue;
+			Item it;
+			if (!iteminit(&it, id, near[i].pt))
+				fatal("Failed to initialize item with ID: %d", id);
+			if (!zoneadditem(zn, near[i].z, it)) {
+				candsrmz(cs, near[i].z);
+				continue;
+			}
+			candsupdate(cs, near[i].z, it.body.bbox);
+			num--;
+		}
+		n = num > 0 ? candsnear(cs, near, num) : 0;
 	}
 
-	zonewrite(stdout, zn);
-	zonefree(zn);
+	zstrmwrite(zs, stdout, bin ? zonewriteb : zonewrite);
+	candsfree(cs);
+	xfree(near);
+	zstrmfree(zs);
 	return 0;
 }
 
-static _Bool goodloc(Zone *zn, int z, Point pt)
+static _Bool goodloc(Zone *zn, int z, Point pt, Point wh)
 {
 	return (pt.x != Startx || pt.y != Starty)
-		&& !zonehasflags(zn, z, pt, (Point) { Twidth, Theight }, Tcollide)
-		&& zoneongrnd(zn, z, pt, (Point) { Twidth, Theight })
-		&& !zoneoverlap(zn, z, pt, (Point) { Twidth, Theight });
-}
-
-static int cmp(const void *_a, const void *_b)
-{
-	const Point *a = (const Point*) _a;
-	const Point *b = (const Point*) _b;
-
-	double da = ptsqdist(*a, (Point){Startx, Starty});
-	double db = ptsqdist(*b, (Point){Startx, Starty});
-
-	if (da < db)
-		return -1;
-	else if (da > db)
-		return 1;
-	return 0;
+		&& !zonehasflags(zn, z, pt, wh, Tcollide)
+		&& zoneongrnd(zn, z, pt, wh)
+		&& !zoneoverlap(zn, z, pt, wh);
 }
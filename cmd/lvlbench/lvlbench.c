@@ -0,0 +1,187 @@
+/* © 2013 the Mid Authors under the MIT license. See AUTHORS for the list of authors.*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../../include/mid.h"
+#include "../../include/log.h"
+#include "../../include/rng.h"
+#include "../../include/gen.h"
+#include "../../include/os.h"
+
+enum { Maxdims = 32 };
+
+/* The generators run on a thread with this much stack, so that
+ * the peak can be measured. */
+enum { Stksz = 64 << 20 };
+
+typedef struct Dims Dims;
+struct Dims {
+	int w, h, d;
+};
+
+typedef struct Run Run;
+struct Run {
+	Dims dims;
+	unsigned long seed;
+	int num;
+
+	Lvlstats *stats;	// one for each level
+	Lvlstats tot;
+	double maxms;
+	unsigned long maxseed;
+	int maxattempts;
+};
+
+static void parseargs(int, char *[]);
+static void run(void *);
+static void prtab(Run *, long);
+static void prjson(Run *, long, _Bool);
+
+static Dims defdims[] = {
+	{ 25, 25, 3 },
+	{ 30, 30, 4 },
+	{ 100, 100, 4 },
+	{ 200, 200, 4 },
+	{ 512, 512, 4 },
+};
+
+static Dims dims[Maxdims];
+static int ndims;
+static int num = 10;
+static unsigned long seed = 1;
+static _Bool json;
+
+// Lvlbench generates num levels of each of the given sizes, from
+// consecutive seeds, and prints the time per level and per attempt,
+// the retries, how much of the level is reachable, how the time is
+// split between the phases of the generator, and the peak stack
+// used by the generator.  With -json, the statistics of each level
+// are printed too.
+int main(int argc, char *argv[])
+{
+	loginit(NULL);
+	parseargs(argc, argv);
+
+	if (json)
+		printf("[\n");
+	else
+		printf("%5s %5s %3s %6s %9s %9s %10s %8s %8s %8s %6s %8s %6s %6s %6s %6s %9s\n",
+			"w", "h", "d", "levels", "mean ms", "max ms", "max seed",
+			"attempts", "max att", "ms/att", "reach", "segs",
+			"path%", "more%", "units%", "unrch%", "stack KB");
+	for (int i = 0; i < ndims; i++) {
+		Run r = { dims[i], seed, num };
+		r.stats = xalloc(num, sizeof(r.stats[0]));
+		long stk = stkpeak(run, &r, Stksz);
+		if (stk < 0)
+			fatal("Failed to run the generator thread");
+		if (json)
+			prjson(&r, stk, i == ndims - 1);
+		else
+			prtab(&r, stk);
+		xfree(r.stats);
+	}
+	if (json)
+		printf("]\n");
+
+	return 0;
+}
+
+static void prtab(Run *r, long stk)
+{
+	Lvlstats *t = &r->tot;
+	printf("%5d %5d %3d %6d %9.3f %9.3f %10lu %8.2f %8d %8.3f %6.3f %8.1f %6.1f %6.1f %6.1f %6.1f %9.1f\n",
+		r->dims.w, r->dims.h, r->dims.d, r->num,
+		t->ms / r->num, r->maxms, r->maxseed,
+		(double) t->attempts / r->num, r->maxattempts,
+		t->ms / t->attempts,
+		t->reach / r->num, (double) t->segs / r->num,
+		100 * t->pathms / t->ms, 100 * t->morereachms / t->ms,
+		100 * t->closeunitsms / t->ms, 100 * t->closeunreachms / t->ms,
+		stk / 1024.0);
+}
+
+static void prjson(Run *r, long stk, _Bool last)
+{
+	Lvlstats *t = &r->tot;
+	printf("{\"w\": %d, \"h\": %d, \"d\": %d, \"levels\": %d, \"stack_kb\": %.1f,\n",
+		r->dims.w, r->dims.h, r->dims.d, r->num, stk / 1024.0);
+	printf(" \"mean_ms\": %.3f, \"max_ms\": %.3f, \"max_seed\": %lu, \"mean_attempts\": %.3f, \"max_attempts\": %d,\n",
+		t->ms / r->num, r->maxms, r->maxseed,
+		(double) t->attempts / r->num, r->maxattempts);
+	printf(" \"seeds\": [\n");
+	for (int i = 0; i < r->num; i++) {
+		Lvlstats *s = &r->stats[i];
+		printf("  {\"seed\": %lu, \"ms\": %.3f, \"attempts\": %d, \"ms_per_attempt\": %.3f, "
+			"\"reach\": %.4f, \"segs\": %d, \"path_ms\": %.3f, \"morereach_ms\": %.3f, "
+			"\"closeunits_ms\": %.3f, \"closeunreach_ms\": %.3f}%s\n",
+			r->seed + i, s->ms, s->attempts, s->ms / s->attempts,
+			s->reach, s->segs, s->pathms, s->morereachms,
+			s->closeunitsms, s->closeunreachms,
+			i < r->num - 1 ? "," : "");
+	}
+	printf(" ]}%s\n", last ? "" : ",");
+}
+
+static void parseargs(int argc, char *argv[])
+{
+	int i;
+	for (i = 1; i < argc; i++) {
+		if (i < argc - 1 && strcmp("-n", argv[i]) == 0)
+			num = strtol(argv[++i], NULL, 10);
+		else if (i < argc - 1 && strcmp("-s", argv[i]) == 0)
+			seed = strtoul(argv[++i], NULL, 10);
+		else if (strcmp("-json", argv[i]) == 0)
+			json = 1;
+		else
+			break;
+	}
+
+	for ( ; i + 2 < argc && ndims < Maxdims; i += 3) {
+		dims[ndims++] = (Dims) {
+			strtol(argv[i], NULL, 10),
+			strtol(argv[i+1], NULL, 10),
+			strtol(argv[i+2], NULL, 10),
+		};
+	}
+	if (i < argc)
+		fatal("Usage: lvlbench [-n <num>] [-s <seed>] [-json] [<w> <h> <d>]...");
+
+	if (ndims == 0) {
+		ndims = sizeof(defdims) / sizeof(defdims[0]);
+		memcpy(dims, defdims, sizeof(defdims));
+	}
+	if (num < 1)
+		num = 1;
+}
+
+static void run(void *arg)
+{
+	Run *r = arg;
+
+	for (int i = 0; i < r->num; i++) {
+		Rng rng;
+		rnginit(&rng, r->seed + i);
+
+		Lvlstats *s = &r->stats[i];
+		Lvl *lvl = lvlgenstats(&rng, r->dims.w, r->dims.h, r->dims.d, 0, s);
+		lvlfree(lvl);
+
+		Lvlstats *t = &r->tot;
+		t->attempts += s->attempts;
+		t->segs += s->segs;
+		t->reach += s->reach;
+		t->ms += s->ms;
+		t->pathms += s->pathms;
+		t->morereachms += s->morereachms;
+		t->closeunitsms += s->closeunitsms;
+		t->closeunreachms += s->closeunreachms;
+		if (s->ms > r->maxms) {
+			r->maxms = s->ms;
+			r->maxseed = r->seed + i;
+		}
+		if (s->attempts > r->maxattempts)
+			r->maxattempts = s->attempts;
+	}
+}
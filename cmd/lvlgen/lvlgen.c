@@ -1,28 +1,50 @@
 /* © 2013 the Mid Authors under the MIT license. See AUTHORS for the list of authors.*/
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <stdbool.h>
 #include <time.h>
-#include <assert.h>
 #include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
 #include "../../include/mid.h"
 #include "../../include/log.h"
 #include "../../include/rng.h"
-#include "lvlgen.h"
+#include "../../include/gen.h"
+#include "../../include/os.h"
+
+enum { Bufsz = 1024 };
 
 static void parseargs(int, char *[]);
-static void rng(Rng *);
-static void init(Lvl *l);
-extern void lvlwrite(FILE *, Lvl *);
-static void stairs(Rng *, Lvl *, unsigned int, unsigned int);
-static int stairlocs(Lvl *, Loc []);
+static uint64_t seed(void);
+static void batch(void);
+static void batchthrd(void *);
+static Lvl *gen(Rng *);
+static void out(FILE *, Lvl *);
 
 static char *seedstr = NULL;
-static bool addwater = true;
-static bool randstart;
-static bool omitexit;
-Rng r;
+static unsigned int flags;
+static int w, h, d;
+
+/* Write a binary .zoneb zone instead of the text level. */
+static int bin;
+
+/* Write a streamed zone, which the later stages of a pipeline
+ * append to instead of rewriting. */
+static int strm;
+
+/* If non-zero, this many attempts are run in parallel. */
+static int spec;
+
+/* Batch mode.  Level i is generated from seed base+i and written
+ * to outdir/<seed>.lvl, exactly as lvlgen -s <seed> would print it,
+ * or to outdir/<seed>.zoneb with -b. */
+static int count;
+static int nthrds = 1;
+static char *outdir;
+static uint64_t base;
+static int next;
+static Mtx *nextmtx;
 
 int main(int argc, char *argv[])
 {
@@ -31,51 +53,21 @@ int main(int argc, char *argv[])
 	if (argc < 4)
 		fatal("Expected 3 arguments");
 
-	parseargs(argc, argv);
-	rng(&r);
+	w = strtol(argv[1], NULL, 10);
+	h = strtol(argv[2], NULL, 10);
+	d = strtol(argv[3], NULL, 10);
 
-	int w = strtol(argv[1], NULL, 10);
-	int h = strtol(argv[2], NULL, 10);
-	int d = strtol(argv[3], NULL, 10);
-	Lvl *lvl = lvlnew(d, w, h, 0);
+	parseargs(argc, argv);
 
-	unsigned int x0 = 2, y0 = 2;
-	if (randstart) {
-		x0 = rnd(1, w-2);
-		y0 = rnd(1, h-2);
+	if (count > 0) {
+		batch();
+		return 0;
 	}
 
-	mvsinit();
-
-	do{
-		init(lvl);
-		if (addwater)
-			water(lvl);
-
-		Loc loc = (Loc) { x0, y0, 0 };
-		Path *p = pathnew(lvl);
-		pathbuild(lvl, p, loc);
-		pathfree(p);
+	Rng r;
+	rnginit(&r, seed());
 
-		morereach(lvl);
-		closeunits(lvl);
-	}while(closeunreach(lvl) < lvl->w * lvl->h * lvl->d * 0.40);
-
-	stairs(&r, lvl, x0, y0);
-
-	bool foundstart = false;
-	for (int x = 0; x < w; x++) {
-	for (int y = 0; y < h; y++) {
-		if (blk(lvl, x, y, 0)->tile == 'u' || blk(lvl, x, y, 0)->tile == 'U') {
-			foundstart = true;
-			break;
-		}
-	}
-	}
-	assert(foundstart);
-
-	lvlwrite(stdout, lvl);
-	lvlfree(lvl);
+	out(stdout, gen(&r));
 
 	return 0;
 }
@@ -86,91 +78,114 @@ static void parseargs(int argc, char *argv[])
 		if (i < argc - 1 && strcmp("-s", argv[i]) == 0) {
 			seedstr = argv[++i];
 		} else if (strcmp("-w", argv[i]) == 0) {
-			addwater = false;
+			flags |= Lvlnowater;
 		} else if (strcmp("-r", argv[i]) == 0) {
-			randstart = true;
+			flags |= Lvlrandstart;
 		} else if (strcmp("-x", argv[i]) == 0) {
-			omitexit = true;
+			flags |= Lvlnoexit;
+		} else if (strcmp("-b", argv[i]) == 0) {
+			bin = 1;
+		} else if (strcmp("-S", argv[i]) == 0) {
+			strm = 1;
+		} else if (i < argc - 1 && strcmp("-n", argv[i]) == 0) {
+			count = strtol(argv[++i], NULL, 10);
+		} else if (i < argc - 1 && strcmp("-j", argv[i]) == 0) {
+			nthrds = strtol(argv[++i], NULL, 10);
+		} else if (i < argc - 1 && strcmp("-o", argv[i]) == 0) {
+			outdir = argv[++i];
+		} else if (i < argc - 1 && strcmp("-k", argv[i]) == 0) {
+			spec = strtol(argv[++i], NULL, 10);
 		}
 	}
-}
-
-static void rng(Rng *r)
-{
-	uint64_t seed = time(0) ^ getpid() ^ getpid() << 16;
 
-	if (seedstr)
-		seed = strtoul(seedstr, NULL, 10);
-
-	rnginit(r, seed);
+	if (count > 0 && !outdir)
+		fatal("-n requires an output directory, given with -o");
+	if (nthrds < 1)
+		nthrds = 1;
+	if (spec < 0)
+		spec = 0;
 }
 
-static void init(Lvl *l)
+static Lvl *gen(Rng *r)
 {
-	for (int z = 0; z < l->d; z++) {
-	for (int y = 0; y < l->h; y++) {
-	for (int x = 0; x < l->w; x++) {
-		int c = ' ';
-		if (x == 0 || x == l->w - 1 || y == 0 || y == l->h - 1)
-			c = '#';
-		*blk(l, x, y, z) = (Blk) { .tile = c };
-	}
-	}
-	}
+	if (spec > 0)
+		return lvlgenspec(r, w, h, d, flags, spec);
+	return lvlgen(r, w, h, d, flags);
 }
 
-unsigned int rnd(int min, int max)
+static uint64_t seed(void)
 {
-	return rngintincl(&r, min, max);
+	if (seedstr)
+		return strtoul(seedstr, NULL, 10);
+	return time(0) ^ getpid() ^ getpid() << 16;
 }
 
-static void stairs(Rng *r, Lvl *lvl, unsigned int x0, unsigned int y0)
+static void batch(void)
 {
-	if (tileinfo(lvl, x0, y0, 0).flags & Twater)
-		blk(lvl, x0, y0, 0)->tile = 'U';
-	else
-		blk(lvl, x0, y0, 0)->tile = 'u';
-	setreach(lvl, x0, y0, 0);
-
-	if (omitexit)
-		return;
-
-	Loc ls[lvl->w * lvl->h * lvl->d];
-	int nls = stairlocs(lvl, ls);
-	if (nls == 0)
-		fatal("No stair locations");
+	base = seed();
+	if (makedir(outdir) < 0 && errno != EEXIST)
+		fatal("Failed to make %s: %s", outdir, strerror(errno));
+	struct stat sb;
+	if (stat(outdir, &sb) < 0 || !S_ISDIR(sb.st_mode))
+		fatal("%s is not a directory", outdir);
+
+	nextmtx = mtxnew();
+	if (!nextmtx)
+		fatal("Failed to create a mutex");
+
+	Thrd **thrds = xalloc(nthrds, sizeof(thrds[0]));
+	for (int i = 0; i < nthrds; i++) {
+		thrds[i] = thrdnew(batchthrd, NULL);
+		if (!thrds[i])
+			fatal("Failed to start worker thread %d", i);
+	}
+	for (int i = 0; i < nthrds; i++)
+		thrdjoin(thrds[i]);
+	xfree(thrds);
 
-	Loc l = ls[rnd(0, nls - 1)];
-	if (tileinfo(lvl, l.x, l.y, l.z).flags & Twater)
-		blk(lvl, l.x, l.y, l.z)->tile = 'D';
-	else
-		blk(lvl, l.x, l.y, l.z)->tile = 'd';
-	setreach(lvl, l.x, l.y, l.z);
+	mtxfree(nextmtx);
 }
 
-static int stairlocs(Lvl *lvl, Loc ls[])
+static void batchthrd(void *unused)
 {
-	int nls = 0;
-	for (int z = 0; z < lvl->d; z++)
-	for (int x = 1; x < lvl->w-1; x++)
-	for (int y = 1; y < lvl->h-2; y++) {
-		if (reachable(lvl, x, y, z) &&  tileinfo(lvl, x, y+1, z).flags & Tcollide
-			&& !(tileinfo(lvl, x, y, z).flags & (Tfdoor | Tbdoor | Tup))) {
-			ls[nls] = (Loc){ x, y, z };
-			nls++;
-		}
+	for ( ; ; ) {
+		mtxlock(nextmtx);
+		int i = next++;
+		mtxunlock(nextmtx);
+		if (i >= count)
+			return;
+
+		unsigned long s = base + i;
+		Rng r;
+		rnginit(&r, s);
+		Lvl *lvl = gen(&r);
+
+		char path[Bufsz];
+		snprintf(path, sizeof(path), "%s/%lu.%s", outdir, s, bin || strm ? "zoneb" : "lvl");
+		FILE *f = fopen(path, "w");
+		if (!f)
+			fatal("Failed to open %s for writing: %s", path, miderrstr());
+		out(f, lvl);
+		_Bool failed = ferror(f);
+		if (fclose(f) != 0 || failed)
+			fatal("Failed to write %s: %s", path, miderrstr());
 	}
-	return nls;
 }
 
-bool reachable(Lvl *l, int x, int y, int z)
+// Writes the level and frees it.  A binary or streamed level is
+// written as a zone with nothing in it, which the other stages
+// read.
+static void out(FILE *f, Lvl *lvl)
 {
-	return blk(l, x, y, z)->flags != 0;
+	if (!bin && !strm) {
+		lvlwrite(f, lvl);
+		lvlfree(lvl);
+		return;
+	}
+	Zone *zn = zonenew(lvl);
+	if (strm)
+		zonewrites(f, zn);
+	else
+		zonewriteb(f, zn);
+	zonefree(zn);
 }
-
-void setreach(Lvl *l, int x, int y, int z)
-{
-	blk(l, x, y, z)->flags = 1;
-	if (blk(l, x, y, z)->tile == '.')
-		blk(l, x, y, z)->tile = ' ';
-}
\ No newline at end of file
@@ -4,7 +4,6 @@
 #include "../../include/log.h"
 #include "../../include/rng.h"
 #include "../../include/os.h"
-#include <dirent.h>
 #include <errno.h>
 #include <stddef.h>
 #include <stdlib.h>
@@ -18,11 +17,45 @@
 
 static char savedir[128] = "_save";
 
+/* The save file in savedir. */
+static const char savename[] = "game.sav";
+
+/* The game's state in a save from before game.sav, which kept it
+ * in this file in savedir along with each zone in <n>.zoneb. */
+static const char oldgame[] = "game";
+
 static void ldresrc();
-static void rmrecur(const char *);
-static FILE *opensavefile(const char *file, const char *mode);
 static const char *savepath(const char *file);
-static _Bool readl(char *buf, int sz, FILE *f);
+static void setdirty(Game *, int);
+static _Bool isdirty(Game *, int);
+static void savethrd(void *);
+static void savefinish(Game *, _Bool);
+static void saveclose(Game *);
+static void savemigrate();
+static void oldsaverm();
+
+/* A snapshot of the game, saved on its own thread while the game
+ * goes on. */
+typedef struct Save Save;
+struct Save {
+	Savefile *sf;
+	Thrd *thrd;
+	Mtx *mtx;
+	/* Set by the thread when the save is written, protected by
+	 * mtx. */
+	_Bool done;
+
+	_Bool died;
+	int znum, zmax, z;
+	uint64_t rngv;
+	Player player;
+
+	/* Copies of the zones to be written, and their numbers. */
+	int n;
+	Zone **zones;
+	int *znums;
+	double snapms;
+};
 
 struct Game {
 	Player player;
@@ -32,6 +65,16 @@ struct Game {
 	Rng rng;
 	Msg msg;
 	Img *ui;
+
+	/* One byte for each of the zones that are not current,
+	 * non-zero if the zone has changed since it was last saved. */
+	unsigned char *dirty;
+	int ndirty;
+
+	/* The save file, or NULL if the game hasn't been saved. */
+	Savefile *sf;
+	/* The save being written, or NULL. */
+	Save *save;
 };
 
 Game *gamenew(void)
@@ -40,6 +83,7 @@ Game *gamenew(void)
 	gm = (Game){};
 
 	lvlinit();
+	zonesaved(NULL);
 
 	unsigned int seed = time(NULL) ^ getpid();
 	rnginit(&gm.rng, seed);
@@ -48,6 +92,8 @@ Game *gamenew(void)
 	gm.zone = zonegen(&gm.rng, 0);
 	if (!gm.zone)
 		fatal("Failed to load zone: %s", miderrstr());
+	gm.zone->dirty = 1;
+	zonepregen(&gm.rng, gm.zmax + 1);
 
 	playerinit(&gm.player, 2, 2);
 
@@ -60,8 +106,11 @@ Game *gamenew(void)
 void gamefree(Scrn *s)
 {
 	Game *gm = s->data;
+	saveclose(gm);
+	zonepregenstop();
 	zonefree(gm->zone);
 	zonecleanup(gm->zmax);
+	xfree(gm->dirty);
 	*gm = (Game){};
 }
 
@@ -70,12 +119,17 @@ static void trystairs(Scrnstk *stk, Game *gm)
 	if (gm->zone->updown == Gonone)
 		return;
 
+	// The zone belongs to the cache once it's put.
+	int updown = gm->zone->updown;
+	if (gm->zone->dirty)
+		setdirty(gm, gm->znum);
 	zoneput(gm->zone, gm->znum);
 
-	if (gm->zone->updown == Goup) {
+	if (updown == Goup) {
 		gm->znum--;
 		if (gm->znum < 0) {
 			pr("You just left the dungeon");
+			saveclose(gm);
 			rmsave();
 			scrnstkpush(stk, goverscrnnew(&gm->player, gm->znum));
 			return;
@@ -86,19 +140,23 @@ static void trystairs(Scrnstk *stk, Game *gm)
 		gm->zone->lvl->z = bi.z;
 		playersetloc(&gm->player, bi.x, bi.y);
 
+		zonepregen(&gm->rng, gm->zmax + 1);
 		lvlsetpallet(lvlpallet(gm));
 		gamesave(gm);
-	} else if (gm->zone->updown == Godown) {
+	} else if (updown == Godown) {
 		gm->znum++;
 		if (gm->znum > gm->zmax) {
 			gm->zmax = gm->znum;
 			gm->zone = zonegen(&gm->rng, gm->znum);
+			gm->zone->dirty = 1;
 		} else {
 			gm->zone = zoneget(gm->znum);
 		}
 
+		gm->zone->lvl->z = 0;
 		playersetloc(&gm->player, 2, 2);
 
+		zonepregen(&gm->rng, gm->zmax + 1);
 		lvlsetpallet(lvlpallet(gm));
 		gamesave(gm);
 	}
@@ -117,9 +175,11 @@ void gameupdate(Scrn *s, Scrnstk *stk)
 	Game *gm = s->data;
 
 	zoneupdate(gm->zone, &gm->player, &gm->msg);
+	savefinish(gm, 0);
 
 	trystairs(stk, gm);
 	if(gm->player.curhp <= 0 && !debugging){
+		saveclose(gm);
 		rmsave();
 		scrnstkpush(stk, goverscrnnew(&gm->player, gm->znum));
 	}
@@ -147,6 +207,7 @@ _Bool dropitem(Zone *z, Player *p, Invit *it) {
 			return 0;
 	}
 
+	z->dirty = 1;
 	*it = (Invit){};
 	return 1;
 }
@@ -205,6 +266,7 @@ void gamehandle(Scrn *s, Scrnstk *stk, Event *e)
 	playerhandle(&gm->player, e);
 
 	if(gm->player.acting){
+		gm->zone->dirty = 1;
 		int z = gm->zone->lvl->z;
 		Env *ev = gm->zone->envs[z];
 		for(int i = 0; i < Maxenvs; i++) {
@@ -232,41 +294,126 @@ void saveloc(const char *l)
 	strncpy(savedir, l, sizeof(savedir)-1);
 }
 
+// Gamesave takes a snapshot of the game and of the zones that
+// have changed since the last save, and adds them to the save
+// file on the save thread while the game goes on.  "Game Saved"
+// is shown once the save is on the disk.
 void gamesave(Game *gm)
 {
 	ignframetime();
-	if (!ensuredir(savedir))
-		die("Failed to make the save directory: %s", miderrstr());
+	// The previous save writes the same files.
+	savefinish(gm, 1);
+	if (!gm->sf) {
+		if (!ensuredir(savedir))
+			die("Failed to make the save directory: %s", miderrstr());
+		gm->sf = savefileopen(savepath(savename), 1);
+		if (!gm->sf)
+			die("Failed to open the save: %s", miderrstr());
+	}
+
+	double t0 = clockms();
+	Save *sv = xalloc(1, sizeof(*sv));
+	sv->sf = gm->sf;
+	sv->died = gm->died;
+	sv->znum = gm->znum;
+	sv->zmax = gm->zmax;
+	sv->z = gm->zone->lvl->z;
+	sv->rngv = gm->rng.v;
+	sv->player = gm->player;
+	sv->zones = xalloc(gm->zmax + 1, sizeof(sv->zones[0]));
+	sv->znums = xalloc(gm->zmax + 1, sizeof(sv->znums[0]));
 
 	for (int i = 0; i <= gm->zmax; i++) {
-		char zfile[128];
-		if (snprintf(zfile, sizeof(zfile), "%d.zone", i) > sizeof(zfile))
-			die("Buffer is too small for the save's zone file");
+		Zone *z = i == gm->znum ? gm->zone : NULL;
+		if ((z ? !z->dirty : !isdirty(gm, i)) && savefilehas(gm->sf, i))
+			continue;
 
-		const char *p = savepath(zfile);
-		FILE *f = fopen(p, "w");
-		if (!f)
-			die("Failed to open zone file for writing [%s]: %s", p, miderrstr());
-		Zone *z = i == gm->znum ? gm->zone : zoneget(i);
-		zonewrite(f, z);
-		fclose(f);
+		Zone *c;
+		if (z) {
+			c = zonecopy(z);
+			if (!c)
+				die("Failed to copy zone %d: %s", i, miderrstr());
+			z->dirty = 0;
+		} else if (!(c = zonecached(i))) {
+			c = zoneget(i);
+		}
+		if (i < gm->ndirty)
+			gm->dirty[i] = 0;
+		sv->zones[sv->n] = c;
+		sv->znums[sv->n++] = i;
 	}
+	sv->snapms = clockms() - t0;
+
+	sv->mtx = mtxnew();
+	if (!sv->mtx)
+		die("Failed to create the save lock");
+	sv->thrd = thrdnew(savethrd, sv);
+	if (!sv->thrd)
+		die("Failed to start the save thread");
+	gm->save = sv;
+}
 
-	FILE *f = opensavefile("game", "w");
-	static char buf[4096];
-	if (!printgeom(buf, sizeof(buf), "bdddul", gm->died, gm->znum, gm->zmax, gm->zone->lvl->z, gm->rng.v, gm->player))
+static void savethrd(void *arg)
+{
+	Save *sv = arg;
+	double t0 = clockms();
+
+	static char buf[Savegamesz];
+	if (!printgeom(buf, sizeof(buf), "bdddul", sv->died, sv->znum, sv->zmax, sv->z, sv->rngv, sv->player))
 		die("Failed to serialize the game information");
-	fputs(buf, f);
-	fputc('\n', f);
-	fclose(f);
+	if (!savefileput(sv->sf, sv->zones, sv->znums, sv->n, buf))
+		die("Failed to save the game: %s", miderrstr());
+	for (int i = 0; i < sv->n; i++)
+		zonefree(sv->zones[i]);
+
+	pr("Saved %d of %d zones: %g ms to copy, %g ms to write", sv->n, sv->zmax + 1,
+		sv->snapms, clockms() - t0);
+
+	mtxlock(sv->mtx);
+	sv->done = 1;
+	mtxunlock(sv->mtx);
+}
+
+// Finishes the save being written, if any, posting "Game Saved"
+// once it is done.  If wait is false and the save isn't done
+// then it returns without finishing it.
+static void savefinish(Game *gm, _Bool wait)
+{
+	Save *sv = gm->save;
+	if (!sv)
+		return;
+	if (!wait) {
+		mtxlock(sv->mtx);
+		_Bool done = sv->done;
+		mtxunlock(sv->mtx);
+		if (!done)
+			return;
+	}
+	thrdjoin(sv->thrd);
+	mtxfree(sv->mtx);
+	xfree(sv->zones);
+	xfree(sv->znums);
+	xfree(sv);
+	gm->save = NULL;
 
 	msg(&gm->msg, "%s", "Game Saved");
 }
 
+// Finishes any save being written and closes the save file.
+static void saveclose(Game *gm)
+{
+	savefinish(gm, 1);
+	zonesaved(NULL);
+	if (gm->sf)
+		savefileclose(gm->sf);
+	gm->sf = NULL;
+}
+
 Game *gameload()
 {
 	if (!ensuredir(savedir))
 		die("Failed to make the save directory: %s", miderrstr());
+	savemigrate();
 
 	static Game gm = {};
 	gm = (Game){};
@@ -274,34 +421,24 @@ Game *gameload()
 	ldresrc();
 	playerinit(&gm.player, 2, 2);
 	
-	static char buf[4096];
-
-	FILE *f = opensavefile("game", "r");
-	if (!readl(buf, sizeof(buf), f))
-		die("Failed to read the game save file: %s", miderrstr());
-	fclose(f);
+	gm.sf = savefileopen(savepath(savename), 0);
+	if (!gm.sf)
+		die("Failed to open the save: %s", miderrstr());
+	static char buf[Savegamesz];
+	snprintf(buf, sizeof(buf), "%s", savefilegame(gm.sf));
 	int z = 0;
 	if (!scangeom(buf, "bdddul", &gm.died, &gm.znum, &gm.zmax, &z, &gm.rng.v, &gm.player))
 		die("Failed to deserialize the game information: %s", miderrstr());
 
-	for (int i = 0; i <= gm.zmax; i++) {
-		char zfile[128];
-		if (snprintf(zfile, sizeof(zfile), "%d.zone", i) > sizeof(zfile))
-			die("Buffer is too small for the save's zone file: %s", miderrstr());
-
-		const char *p = savepath(zfile);
-		FILE *f = fopen(p, "r");
-		if (!f)
-			die("Failed to open zone file for reading [%s]: %s", p, miderrstr());
-		Zone *z = zoneread(f);
-		zoneput(z, i);
-		fclose(f);
-		zonefree(z);
-	}
+	// Zones are read from the save as they are needed, so
+	// any left in the zone directory by an earlier run must go.
+	zonecleanup(gm.zmax);
+	zonesaved(gm.sf);
 
 	gm.zone = zoneget(gm.znum);
 	gm.zone->lvl->z = z;
 	gm.ui = resrcacq(imgs, "img/ui.png", 0);
+	zonepregen(&gm.rng, gm.zmax + 1);
 
 	return &gm;
 }
@@ -320,84 +457,96 @@ static void ldresrc()
 		fatal("Failed to load magic resources: %s", miderrstr());
 }
 
-static FILE *opensavefile(const char *file, const char *mode)
+void rmsave()
 {
-	const char *p = savepath(file);
-	FILE *f = fopen(p, mode);
-	if (!f)
-		die("Failed to open %s file with mode %s [%s]: %s", file, mode, p, miderrstr());
-	return f;
+	const char *p = savepath(savename);
+	if (fsexists(p) && remove(p) != 0)
+		pr("Failed to remove %s: %s", p, strerror(errno));
+	oldsaverm();
 }
 
-void rmsave()
+_Bool saveavailable()
 {
-	if (!saveavailable())
-		return;
-	rmrecur(savedir);
+	return fsexists(savepath(savename)) || fsexists(savepath(oldgame));
 }
 
-// TODO(eaburns): a candidate function for a more general os lib.
-static void rmrecur(const char *path)
+// Moves a save from before game.sav into game.sav, so that an
+// old game goes on where it was left instead of being lost.
+static void savemigrate()
 {
-	struct stat sb;
-
-	if (stat(path, &sb) < 0) {
-		pr("Unable to stat: %s: %s", path, strerror(errno));
-		return;
-	}
-
-	if (!S_ISDIR(sb.st_mode))
-		goto rm;
-
-	DIR *d = opendir(path);
-	if (!d) {
-		pr("Failed to open %s: %s", path, strerror(errno));
+	if (fsexists(savepath(savename)) || !fsexists(savepath(oldgame)))
 		return;
-	}
 
-	struct dirent *ent;
-	for (;;) {
-		errno = 0;
-		ent = readdir(d);
-		if (!ent && errno != 0) {
-			pr("Failed to read %s: %s", path, strerror(errno));
-			break;
-		}
-		if (!ent)
-			break;
-		if (strcmp(ent->d_name, ".") == 0|| strcmp(ent->d_name, "..") == 0)
+	static char buf[Savegamesz], scan[Savegamesz];
+	FILE *f = fopen(savepath(oldgame), "r");
+	if (!f)
+		die("Failed to open the old save's game file: %s", miderrstr());
+	if (!fgets(buf, sizeof(buf), f))
+		die("Failed to read the old save's game file");
+	fclose(f);
+	buf[strcspn(buf, "\n")] = '\0';
+
+	// Only zmax is needed, but it comes after the rest, and
+	// scangeom cuts up the buffer that it scans.
+	memcpy(scan, buf, sizeof(scan));
+	Save sv = {};
+	if (!scangeom(scan, "bdddul", &sv.died, &sv.znum, &sv.zmax, &sv.z, &sv.rngv, &sv.player))
+		die("Failed to deserialize the old save's game information: %s", miderrstr());
+
+	sv.zones = xalloc(sv.zmax + 1, sizeof(*sv.zones));
+	sv.znums = xalloc(sv.zmax + 1, sizeof(*sv.znums));
+	for (int i = 0; i <= sv.zmax; i++) {
+		char zfile[32];
+		snprintf(zfile, sizeof(zfile), "%d.zoneb", i);
+		const char *p = savepath(zfile);
+		if (!fsexists(p))
 			continue;
-
-		// TODO(eaburns): when lib/mid/fs.c is moved into a general os library, we
-		// can change this junk to use fscat, which could be renamed to pathjoin.
-		char *subpath = calloc(sizeof(path) + sizeof(ent->d_name) + 2, 1);
-		if (!subpath)
-			die("calloc failed");
-		strcpy(subpath, path);
-		int l = strlen(subpath);
-		subpath[l] = '/';
-		strcpy(subpath+l+1, ent->d_name);
-
-		rmrecur(subpath);
-
-		free(subpath);
+		FILE *zf = fopen(p, "rb");
+		if (!zf)
+			die("Failed to open the old save's zone %d: %s", i, miderrstr());
+		sv.zones[sv.n] = zoneread(zf);
+		if (!sv.zones[sv.n])
+			die("Failed to read the old save's zone %d: %s", i, miderrstr());
+		fclose(zf);
+		sv.znums[sv.n++] = i;
 	}
 
-	closedir(d);
-
-rm:
-	pr("Removing %s", path);
-	if (remove(path) < 0)
-		pr("Failed to remove %s: %s", path, strerror(errno));
+	Savefile *sf = savefileopen(savepath(savename), 1);
+	if (!sf)
+		die("Failed to create the save: %s", miderrstr());
+	if (!savefileput(sf, sv.zones, sv.znums, sv.n, buf)) {
+		// Leave the old save to be moved on the next run.
+		savefileclose(sf);
+		remove(savepath(savename));
+		die("Failed to move the old save: %s", miderrstr());
+	}
+	savefileclose(sf);
+	for (int i = 0; i < sv.n; i++)
+		zonefree(sv.zones[i]);
+	xfree(sv.zones);
+	xfree(sv.znums);
+
+	oldsaverm();
+	pr("Moved the old save's %d zones into %s", sv.n, savename);
 }
 
-_Bool saveavailable()
+// Removes the files of a save from before game.sav, if any.
+static void oldsaverm()
 {
-	struct stat sb;
-	if (stat(savepath("game"), &sb) < 0) {
-		return false;
+	const char *p = savepath(oldgame);
+	if (!fsexists(p))
+		return;
+	if (remove(p) != 0)
+		pr("Failed to remove %s: %s", p, strerror(errno));
+	for (int i = 0; ; i++) {
+		char zfile[32];
+		snprintf(zfile, sizeof(zfile), "%d.zoneb", i);
+		p = savepath(zfile);
+		if (!fsexists(p))
+			break;
+		if (remove(p) != 0)
+			pr("Failed to remove %s: %s", p, strerror(errno));
 	}
-	return true;
 }
 
 // Non-reentant
@@ -412,23 +561,6 @@ static const char *savepath(const char *file)
 }
 
 // TODO(eaburns): de-duplicate this and the one in ../../lib/mid/zone.c.
-static _Bool readl(char *buf, int sz, FILE *f)
-{
-	extern int isspace(int);
-	char *r = fgets(buf, sz, f);
-	if (!r) {
-		pr("fgets returned NULL");
-		return 0;
-	}
-
-	int l = strlen(buf);
-
-	for(int i = l-1; i >= 0 && isspace(buf[i]); i--)
-		buf[i] = 0;
-
-	return 1;
-}
-
 _Bool ensuredir(const char *d)
 {
 	struct stat sb;
@@ -443,3 +575,26 @@ _Bool ensuredir(const char *d)
 	}
 	return true;
 }
+
+// Records that zone znum, which is no longer current, has
+// changed since it was last saved.
+static void setdirty(Game *gm, int znum)
+{
+	if (znum >= gm->ndirty) {
+		int n = gm->ndirty ? gm->ndirty : 16;
+		while (n <= znum)
+			n *= 2;
+		unsigned char *d = xalloc(n, sizeof(*d));
+		if (gm->dirty)
+			memcpy(d, gm->dirty, gm->ndirty);
+		xfree(gm->dirty);
+		gm->dirty = d;
+		gm->ndirty = n;
+	}
+	gm->dirty[znum] = 1;
+}
+
+static _Bool isdirty(Game *gm, int znum)
+{
+	return znum < gm->ndirty && gm->dirty[znum];
+}
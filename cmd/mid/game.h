@@ -2,12 +2,53 @@
 
 struct Rng;
 
+/* A Savefile is a saved game in a single file: the game's state,
+ * and each zone, indexed by its number. */
+typedef struct Savefile Savefile;
+/* The most bytes of the game's state, as written by printgeom. */
+enum { Savegamesz = 4096 };
+/* Opens the save at path, or, if create is true and there is
+ * none, creates an empty one.  Returns NULL on failure. */
+Savefile *savefileopen(const char *path, _Bool create);
+void savefileclose(Savefile *);
+/* Returns the game's state as of the last savefileput. */
+const char *savefilegame(Savefile *);
+_Bool savefilehas(Savefile *, int znum);
+/* Reads the zone from the save.  Returns NULL on failure. */
+Zone *savefileget(Savefile *, int znum);
+/* Adds the n zones, with the numbers in znums, to the save,
+ * replacing any older copies, along with the game's state, and
+ * syncs it to the disk.  It may be called on any thread.
+ * Returns false on failure. */
+_Bool savefileput(Savefile *, Zone *zones[], int znums[], int n, const char *game);
+
 void zoneloc(const char*);
 /* Notify zone loader to use stdin for the next zone. */
 void zonestdin();
+/* Generate zones with the external pipeline of -gen commands
+ * instead of in-process. */
+void zoneextpipe();
+/* Have the external pipeline end without tee, and write cur.lvl
+ * from mid once the zone has been read instead. */
+void zonenotee();
+/* Have zoneget read zones that aren't in the zone directory from
+ * the save, or from nowhere if it is NULL. */
+void zonesaved(Savefile *);
 Zone *zoneget(int);
 Zone *zonegen(struct Rng *r, int depth);
+/* Start generating the zone for the given depth on a worker
+ * thread from the current state of r.  The next zonegen call for
+ * the depth with r in the same state takes the finished zone. */
+void zonepregen(struct Rng *r, int depth);
+/* Wait for and discard any pre-generated zone. */
+void zonepregenstop();
+/* Hand the zone to the cache, which writes it to the zone
+ * directory once it is evicted.  The cache owns the zone until
+ * zoneget takes it back. */
 void zoneput(Zone *, int);
+/* Return a copy of the zone, as by zonecopy, if it is in the
+ * cache, or NULL if it isn't. */
+Zone *zonecached(int);
 void zonecleanup(int zmax);
 // Find the down stairs in this zone.
 Tileinfo zonedstairs(Zone *zn);
@@ -3,6 +3,8 @@
 #include "../../include/log.h"
 #include "../../include/mid.h"
 #include "../../include/os.h"
+#include "../../include/rng.h"
+#include "../../include/gen.h"
 #include "game.h"
 #include <stdlib.h>
 #include <stdbool.h>
@@ -51,6 +53,9 @@ bool init()
 
 	initresrc();
 
+	if(!genrecipesinit())
+		return false;
+
 	return true;
 }
 
@@ -82,6 +87,10 @@ int main(int argc, char *argv[])
 			mute = 1;
 		}else if (ARGIS('p')){
 			zonestdin();
+		}else if (ARGIS('e')){
+			zoneextpipe();
+		}else if (ARGIS('t')){
+			zonenotee();
 		}
 	}
 
@@ -111,11 +120,13 @@ int main(int argc, char *argv[])
 
 static void usage(int s)
 {
-	puts("Usage: mid [-d] [-h] [-k <file>] [-m] [-p]");
+	puts("Usage: mid [-d] [-e] [-h] [-k <file>] [-m] [-p] [-t]");
 	puts("-d	enable debugging");
+	puts("-e	generate zones with the external -gen command pipeline");
 	puts("-h	print usage information");
 	puts("-k <file>	specify the key map file");
 	puts("-m	mute the sound effects");
 	puts("-p	accept the pipeline from standard input");
+	puts("-t	with -e, write cur.lvl from mid instead of with tee");
 	exit(s);
 }
\ No newline at end of file
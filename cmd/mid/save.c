@@ -0,0 +1,482 @@
+/* © 2013 the Mid Authors under the MIT license. See AUTHORS for the list of authors.*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "../../include/mid.h"
+#include "../../include/log.h"
+#include "../../include/os.h"
+#include "game.h"
+
+enum { Svversion = 2, Pathsz = 1024 };
+
+/* The number of header slots at the start of a save. */
+enum { Nslots = 2 };
+
+/* A save is compacted when more than Wastepct percent of it is
+ * old copies of zones and old tables of contents. */
+enum { Wastepct = 50 };
+
+static const char Svmagic[4] = "MIDV";
+
+/* A header of a save.  The game is the text of the game's state,
+ * and the table of contents is ntoc Svents at tocoff.  Each header
+ * written gets the next sequence number, seq, and sum is the
+ * checksum of the header with a zero sum.  Everything is in the
+ * host's byte order. */
+typedef struct Svhdr Svhdr;
+struct Svhdr {
+	char magic[4];
+	uint32_t version;
+	uint64_t seq;
+	uint64_t tocoff;
+	uint32_t ntoc, sum;
+	char game[Savegamesz];
+};
+
+/* An entry of the table of contents: the zone's offset and
+ * length in the save. */
+typedef struct Svent Svent;
+struct Svent {
+	int32_t znum, pad;
+	uint64_t off, len;
+};
+
+struct Savefile {
+	Mtx *mtx;
+	char path[Pathsz];
+	FILE *f;
+	Svhdr hdr;
+
+	/* The entry of each zone, indexed by its number, with a
+	 * zero len if the zone isn't in the save. */
+	Svent *toc;
+	int ntoc;
+
+	/* The size of the save, and how much of it is the current
+	 * copy of a zone. */
+	uint64_t end, live;
+};
+
+static _Bool hdrread(Savefile *, Svhdr *);
+static _Bool hdrok(Svhdr *);
+static uint32_t hdrsum(Svhdr *);
+static _Bool tocread(Savefile *);
+static void tocgrow(Savefile *, int);
+static _Bool tocwrite(Savefile *, FILE *, uint64_t *);
+static _Bool hdrwrite(Savefile *, FILE *);
+static Svent *ent(Savefile *, int);
+static _Bool compact(Savefile *);
+static _Bool replace(Savefile *, const char *);
+
+/* A save is two header slots, the zones, each written by
+ * zonewritep, and a table of contents.  Saving appends the zones
+ * that changed and a new table of contents, and then writes a
+ * header pointing at it over the older of the two headers, so
+ * the old zones and table are left in the save until it is
+ * compacted.  Reading takes the newest header that is whole, so
+ * a save that is interrupted, even while writing the header,
+ * leaves the previous one intact. */
+Savefile *savefileopen(const char *path, _Bool create)
+{
+	Savefile *sf = xalloc(1, sizeof(*sf));
+	snprintf(sf->path, sizeof(sf->path), "%s", path);
+	sf->mtx = mtxnew();
+	if (!sf->mtx) {
+		seterrstr("Failed to create the save lock");
+		goto err;
+	}
+
+	sf->f = fopen(path, "r+b");
+	if (!sf->f && create) {
+		sf->f = fopen(path, "w+b");
+		if (!sf->f) {
+			seterrstr("Failed to create %s: %s", path, miderrstr());
+			goto err;
+		}
+		memcpy(sf->hdr.magic, Svmagic, sizeof(Svmagic));
+		sf->hdr.version = Svversion;
+		sf->end = Nslots * sizeof(sf->hdr);
+		if (!hdrwrite(sf, sf->f))
+			goto err;
+		return sf;
+	}
+	if (!sf->f) {
+		seterrstr("Failed to open %s: %s", path, miderrstr());
+		goto err;
+	}
+
+	Svhdr *hdrs = xalloc(Nslots, sizeof(*hdrs));
+	if (fread(hdrs, sizeof(*hdrs), Nslots, sf->f) != Nslots) {
+		seterrstr("Failed to read the save header");
+		xfree(hdrs);
+		goto err;
+	}
+	if (fseek(sf->f, 0, SEEK_END) != 0) {
+		seterrstr("Failed to seek the save: %s", miderrstr());
+		xfree(hdrs);
+		goto err;
+	}
+	sf->end = ftell(sf->f);
+	_Bool ok = hdrread(sf, hdrs);
+	xfree(hdrs);
+	if (!ok)
+		goto err;
+	return sf;
+err:
+	savefileclose(sf);
+	return NULL;
+}
+
+void savefileclose(Savefile *sf)
+{
+	if (sf->f)
+		fclose(sf->f);
+	if (sf->mtx)
+		mtxfree(sf->mtx);
+	xfree(sf->toc);
+	xfree(sf);
+}
+
+const char *savefilegame(Savefile *sf)
+{
+	return sf->hdr.game;
+}
+
+_Bool savefilehas(Savefile *sf, int znum)
+{
+	mtxlock(sf->mtx);
+	_Bool has = ent(sf, znum) != NULL;
+	mtxunlock(sf->mtx);
+	return has;
+}
+
+// Savefileget reads the packed zone with one read and decodes it
+// from the buffer.
+Zone *savefileget(Savefile *sf, int znum)
+{
+	mtxlock(sf->mtx);
+	Svent *e = ent(sf, znum);
+	if (!e) {
+		mtxunlock(sf->mtx);
+		seterrstr("Zone %d isn't in the save", znum);
+		return NULL;
+	}
+	if (!sf->f) {
+		mtxunlock(sf->mtx);
+		seterrstr("The save isn't open");
+		return NULL;
+	}
+	unsigned long len = e->len;
+	char *buf = xalloc(len, 1);
+	long n = readat(sf->f, buf, len, e->off);
+	mtxunlock(sf->mtx);
+
+	if (n < 0 || (unsigned long) n != len) {
+		seterrstr("Failed to read zone %d from the save", znum);
+		xfree(buf);
+		return NULL;
+	}
+	Zone *zn = zonereadmem(buf, len);
+	xfree(buf);
+	return zn;
+}
+
+_Bool savefileput(Savefile *sf, Zone *zones[], int znums[], int n, const char *game)
+{
+	mtxlock(sf->mtx);
+	_Bool ok = false;
+
+	if (!sf->f) {
+		seterrstr("The save isn't open");
+		goto out;
+	}
+	if (fseek(sf->f, sf->end, SEEK_SET) != 0) {
+		seterrstr("Failed to seek the save: %s", miderrstr());
+		goto out;
+	}
+	for (int i = 0; i < n; i++) {
+		uint64_t off = sf->end;
+		zonewritep(sf->f, zones[i]);
+		if (ferror(sf->f)) {
+			seterrstr("Failed to write zone %d to the save", znums[i]);
+			goto out;
+		}
+		sf->end = ftell(sf->f);
+
+		int znum = znums[i];
+		tocgrow(sf, znum);
+		Svent *e = &sf->toc[znum];
+		sf->live -= e->len;
+		*e = (Svent) { .znum = znum, .off = off, .len = sf->end - off };
+		sf->live += e->len;
+	}
+
+	snprintf(sf->hdr.game, sizeof(sf->hdr.game), "%s", game);
+	if (!tocwrite(sf, sf->f, &sf->end))
+		goto out;
+	// The zones and the table must be on the disk before the
+	// header points to them.
+	if (syncfile(sf->f) != 0) {
+		seterrstr("Failed to sync the save: %s", miderrstr());
+		goto out;
+	}
+	if (!hdrwrite(sf, sf->f))
+		goto out;
+
+	// The game is saved even if compacting the save fails.
+	uint64_t used = Nslots * sizeof(sf->hdr) + sf->live + sf->hdr.ntoc * sizeof(Svent);
+	ok = true;
+	if ((sf->end - used) * 100 > sf->end * Wastepct && !compact(sf))
+		pr("Failed to compact the save: %s", miderrstr());
+out:
+	mtxunlock(sf->mtx);
+	return ok;
+}
+
+// Takes the newest of the headers that is whole and whose table
+// of contents can be read.
+static _Bool hdrread(Savefile *sf, Svhdr *hdrs)
+{
+	int newest = 0;
+	for (int i = 1; i < Nslots; i++) {
+		if (hdrs[i].seq > hdrs[newest].seq)
+			newest = i;
+	}
+	for (int i = 0; i < Nslots; i++) {
+		Svhdr *h = &hdrs[(newest + Nslots - i) % Nslots];
+		if (!hdrok(h))
+			continue;
+		sf->hdr = *h;
+		sf->hdr.game[Savegamesz - 1] = '\0';
+		if (tocread(sf))
+			return true;
+		xfree(sf->toc);
+		sf->toc = NULL;
+		sf->ntoc = 0;
+		sf->live = 0;
+	}
+	return false;
+}
+
+static _Bool hdrok(Svhdr *h)
+{
+	if (memcmp(h->magic, Svmagic, sizeof(Svmagic)) != 0) {
+		seterrstr("Not a save");
+		return false;
+	}
+	if (h->version != Svversion) {
+		seterrstr("Unsupported save version %u", (unsigned) h->version);
+		return false;
+	}
+	if (h->sum != hdrsum(h)) {
+		seterrstr("Bad save header checksum");
+		return false;
+	}
+	return true;
+}
+
+// The FNV-1a hash of the header with a zero sum.
+static uint32_t hdrsum(Svhdr *h)
+{
+	Svhdr z = *h;
+	z.sum = 0;
+	unsigned char *p = (unsigned char *) &z;
+	uint32_t sum = 2166136261u;
+	for (size_t i = 0; i < sizeof(z); i++)
+		sum = (sum ^ p[i]) * 16777619u;
+	return sum;
+}
+
+static _Bool tocread(Savefile *sf)
+{
+	uint64_t ntoc = sf->hdr.ntoc;
+	if (sf->hdr.tocoff > sf->end || ntoc > (sf->end - sf->hdr.tocoff) / sizeof(Svent)) {
+		seterrstr("Bad save table of contents");
+		return false;
+	}
+	if (ntoc == 0)
+		return true;
+
+	Svent *es = xalloc(ntoc, sizeof(*es));
+	long n = readat(sf->f, es, ntoc * sizeof(*es), sf->hdr.tocoff);
+	if (n < 0 || (uint64_t) n != ntoc * sizeof(*es)) {
+		seterrstr("Failed to read the save table of contents");
+		xfree(es);
+		return false;
+	}
+
+	for (uint64_t i = 0; i < ntoc; i++) {
+		Svent e = es[i];
+		if (e.znum < 0 || e.len == 0 || e.off > sf->end || e.len > sf->end - e.off) {
+			seterrstr("Bad save table of contents entry %llu", (unsigned long long) i);
+			xfree(es);
+			return false;
+		}
+		tocgrow(sf, e.znum);
+		sf->toc[e.znum] = e;
+		sf->live += e.len;
+	}
+	xfree(es);
+	return true;
+}
+
+// Makes room in the table of contents for zone znum.
+static void tocgrow(Savefile *sf, int znum)
+{
+	if (znum < sf->ntoc)
+		return;
+	Svent *toc = xalloc(znum + 1, sizeof(*toc));
+	if (sf->toc)
+		memcpy(toc, sf->toc, sf->ntoc * sizeof(*toc));
+	xfree(sf->toc);
+	sf->toc = toc;
+	sf->ntoc = znum + 1;
+}
+
+// Writes the table of contents to f at *end, advancing *end past
+// it, and points the in-memory header at it.
+static _Bool tocwrite(Savefile *sf, FILE *f, uint64_t *end)
+{
+	if (fseek(f, *end, SEEK_SET) != 0) {
+		seterrstr("Failed to seek the save: %s", miderrstr());
+		return false;
+	}
+	uint32_t ntoc = 0;
+	for (int i = 0; i < sf->ntoc; i++) {
+		if (!sf->toc[i].len)
+			continue;
+		if (fwrite(&sf->toc[i], sizeof(Svent), 1, f) != 1) {
+			seterrstr("Failed to write the save table of contents");
+			return false;
+		}
+		ntoc++;
+	}
+	sf->hdr.tocoff = *end;
+	sf->hdr.ntoc = ntoc;
+	*end += ntoc * sizeof(Svent);
+	return true;
+}
+
+// Writes the header with the next sequence number to its slot,
+// which holds the older of the two headers.
+static _Bool hdrwrite(Savefile *sf, FILE *f)
+{
+	sf->hdr.seq++;
+	sf->hdr.sum = hdrsum(&sf->hdr);
+	long off = (sf->hdr.seq % Nslots) * sizeof(sf->hdr);
+	if (fseek(f, off, SEEK_SET) != 0 || fwrite(&sf->hdr, sizeof(sf->hdr), 1, f) != 1) {
+		seterrstr("Failed to write the save header");
+		goto err;
+	}
+	if (syncfile(f) != 0) {
+		seterrstr("Failed to sync the save: %s", miderrstr());
+		goto err;
+	}
+	return true;
+err:
+	// The slot may be torn, so the next header must go to it
+	// again and not over the newest whole one.
+	sf->hdr.seq--;
+	return false;
+}
+
+// Must be called with the save's lock held.
+static Svent *ent(Savefile *sf, int znum)
+{
+	if (znum < 0 || znum >= sf->ntoc || !sf->toc[znum].len)
+		return NULL;
+	return &sf->toc[znum];
+}
+
+// Copies the current zones to a new save, and renames it over
+// the old one.  On failure the old save is left as it was.
+static _Bool compact(Savefile *sf)
+{
+	double t0 = clockms();
+	uint64_t oldsz = sf->end;
+
+	char tmp[Pathsz + 8];
+	snprintf(tmp, sizeof(tmp), "%s.tmp", sf->path);
+	FILE *f = fopen(tmp, "w+b");
+	if (!f) {
+		seterrstr("Failed to create %s: %s", tmp, miderrstr());
+		return false;
+	}
+
+	Svent *toc = xalloc(sf->ntoc ? sf->ntoc : 1, sizeof(*toc));
+	uint64_t end = Nslots * sizeof(sf->hdr);
+	if (fseek(f, end, SEEK_SET) != 0) {
+		seterrstr("Failed to seek %s: %s", tmp, miderrstr());
+		goto err;
+	}
+	for (int i = 0; i < sf->ntoc; i++) {
+		Svent e = sf->toc[i];
+		if (!e.len)
+			continue;
+		char *buf = xalloc(e.len, 1);
+		long n = readat(sf->f, buf, e.len, e.off);
+		if (n < 0 || (uint64_t) n != e.len || fwrite(buf, 1, e.len, f) != e.len) {
+			seterrstr("Failed to copy zone %d to %s", i, tmp);
+			xfree(buf);
+			goto err;
+		}
+		xfree(buf);
+		toc[i] = e;
+		toc[i].off = end;
+		end += e.len;
+	}
+
+	Svhdr oldhdr = sf->hdr;
+	Svent *oldtoc = sf->toc;
+	sf->toc = toc;
+	_Bool ok = tocwrite(sf, f, &end) && hdrwrite(sf, f);
+	if (fclose(f) != 0 && ok) {
+		seterrstr("Failed to close %s: %s", tmp, miderrstr());
+		ok = false;
+	}
+	f = NULL;
+	if (!ok || !replace(sf, tmp)) {
+		sf->hdr = oldhdr;
+		sf->toc = oldtoc;
+		goto err;
+	}
+	xfree(oldtoc);
+	sf->end = end;
+	pr("Compacted the save from %llu to %llu bytes in %g ms", (unsigned long long) oldsz,
+		(unsigned long long) end, clockms() - t0);
+	return true;
+err:
+	if (f)
+		fclose(f);
+	remove(tmp);
+	xfree(toc);
+	return false;
+}
+
+// Renames tmp over the save and opens it in place of the old one,
+// which is kept open until it has been replaced.  Windows won't
+// replace an open file, so if that fails the old save is closed
+// and replaced again, and reopened if it still can't be.
+static _Bool replace(Savefile *sf, const char *tmp)
+{
+	if (renameover(tmp, sf->path) != 0) {
+		fclose(sf->f);
+		sf->f = NULL;
+		if (renameover(tmp, sf->path) != 0) {
+			seterrstr("Failed to rename %s to %s: %s", tmp, sf->path, miderrstr());
+			sf->f = fopen(sf->path, "r+b");
+			return false;
+		}
+	}
+	FILE *f = fopen(sf->path, "r+b");
+	if (!f) {
+		seterrstr("Failed to open %s: %s", sf->path, miderrstr());
+		return false;
+	}
+	if (sf->f)
+		fclose(sf->f);
+	sf->f = f;
+	return true;
+}
@@ -1,13 +1,15 @@
 /* © 2013 the Mid Authors under the MIT license. See AUTHORS for the list of authors.*/
 
 #include <assert.h>
-#include <stdarg.h>
+#include <errno.h>
 #include <string.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <dirent.h>
 #include "../../include/mid.h"
 #include "../../include/log.h"
 #include "../../include/rng.h"
+#include "../../include/gen.h"
 #include "game.h"
 #include <stdio.h>
 #include "../../include/os.h"
@@ -16,21 +18,131 @@ extern int cmdpath(char *buf, int sz, char *cmd);
 
 enum { Bufsz = 1024 };
 static char zonedir[Bufsz] = "_zones";
+static char pooldir[Bufsz] = "_zonepool";
 
+/* The most stages of the generation pipeline and arguments to
+ * lvlgen. */
+enum { Maxpipe = 8, Maxargs = 16 };
+
+/* The generation pipeline: each stage's argument vector, and the
+ * running pipeline. */
 typedef struct Pipe {
 	int n;
-	char cmd[Bufsz];
+	char **argv[Maxpipe];
+	Pipeln *pl;
 } Pipe;
 
+/* A zone generated ahead of time on a worker thread. */
+typedef struct Pregen {
+	Thrd *thrd;
+	Mtx *mtx;
+	Cnd *cnd;
+
+	int depth;
+	/* The state of the game's Rng when generation started. */
+	uint64_t seed;
+	/* The worker's copy of the Rng, advanced by generation. */
+	Rng rng;
+
+	/* Set by the worker, protected by mtx. */
+	_Bool done;
+	Zone *zone;
+	char err[Bufsz];
+
+	/* The next of the pre-generations that were given up on,
+	 * which are kept until their workers finish. */
+	struct Pregen *next;
+} Pregen;
+
+/* How long to wait for a pre-generated zone before giving up, in
+ * milliseconds. */
+enum { Pregenwait = 60000 };
+
+/* The number of zones that zonepool keeps for each recipe. */
+enum { Poolsz = 2 };
+
+/* The number of zones kept in the cache, the most zones that it
+ * holds counting those evicted but not yet written, and how often
+ * the zones in it are written out, in milliseconds. */
+enum { Cachesz = 4, Maxcached = 2 * Cachesz, Flushms = 10000 };
+
+/* A zone in the cache. */
+typedef struct Cached {
+	Zone *zn;
+	int znum;
+	/* When the zone was put, for finding the least recently
+	 * used. */
+	unsigned long used;
+	/* The zone file is up to date. */
+	_Bool written;
+	/* The zone is no longer cached, and is freed once written. */
+	_Bool evicted;
+	/* The zone is being written by the cache's thread. */
+	_Bool busy;
+} Cached;
+
+/* The zones most recently put, kept in memory so that going back
+ * to one doesn't read it from disk.  A thread writes evicted
+ * zones to the zone directory, and every Flushms it writes those
+ * that are still cached. */
+typedef struct Zcache {
+	Thrd *thrd;
+	Mtx *mtx;
+	Cnd *cnd;
+
+	/* Protected by mtx. */
+	Cached ents[Maxcached];
+	int n;
+	unsigned long tick;
+	_Bool quit;
+
+	int hits, misses;
+} Zcache;
+
 static FILE *inzone = NULL;
+static _Bool extpipe;
+static _Bool notee;
+static Pregen *pregen;
+static Pregen *abandoned;
+static Zcache *cache;
+static Savefile *saved;
+static int poolhits, poolmisses;
 
 static char *zonefile(int);
-static FILE *zpipe(Rng *r, int);
-static void pipeadd(struct Pipe *, char *, char *, ...);
+static Pipe *zpipe(Rng *r, int depth);
+static void pipeadd(Pipe *, char *, char *[]);
+static int pipeclosep(Pipe *);
+static void writecur(Zone *);
+static void writezone(Zone *, int);
+static void cachestart(void);
+static void cachestop(void);
+static Cached *cachefind(int);
+static Zone *cachetake(int);
+static void cachethrd(void *);
+static void pregenthrd(void *);
+static void pregendrop(void);
+static void pregenreap(_Bool);
+static void pregenfree(Pregen *);
+static Zone *pregentake(Rng *, int);
+static Zone *gen(Rng *, int);
+static Zone *pooltake(Rng *, int);
+static Zone *poolclaim(const char *);
+static _Bool poolname(const char *, int, unsigned long *);
+static int poolcount(int);
+static void poolfill(int);
 
 void zoneloc(const char *p)
 {
 	strncpy(zonedir, p, sizeof(zonedir)-1);
+
+	const char *s = strrchr(p, '/');
+	int n = s ? s - p + 1 : 0;
+	snprintf(pooldir, sizeof(pooldir), "%.*szonepool", n, p);
+}
+
+void zonesaved(Savefile *sf)
+{
+	saved = sf;
 }
 
 void zonestdin()
@@ -38,13 +150,37 @@ void zonestdin()
 	inzone = stdin;
 }
 
+void zoneextpipe()
+{
+	extpipe = 1;
+}
+
+void zonenotee()
+{
+	notee = 1;
+}
+
 Zone *zonegen(Rng *r, int depth)
 {
 	ignframetime();
-	FILE *fin = inzone;
 
-	if (!fin)
-		fin = zpipe(r, depth);
+	if (!inzone && !extpipe) {
+		Zone *z = pregentake(r, depth);
+		if (!z)
+			z = gen(r, depth);
+		if (!z)
+			die("Failed to generate the zone: %s", miderrstr());
+		writecur(z);
+		poolfill(depth);
+		return z;
+	}
+
+	FILE *fin = inzone;
+	Pipe *p = NULL;
+	if (!fin) {
+		p = zpipe(r, depth);
+		fin = pipelnout(p->pl);
+	}
 	Zone *z = zoneread(fin);
 	if (!z)
 		die("Failed to read the zone: %s", miderrstr());
@@ -53,24 +189,291 @@ Zone *zonegen(Rng *r, int depth)
 		fclose(fin);
 		inzone = NULL;
 	} else {
-		int ret = pipeclose(fin);
+		int ret = pipeclosep(p);
 		if (ret == -1)
 			die("Zone gen pipeline exited with failure: %s", miderrstr());
+		if (notee)
+			writecur(z);
+	}
+
+	return z;
+}
+
+void zonepregen(Rng *r, int depth)
+{
+	if (inzone || extpipe)
+		return;
+	if (pregen && pregen->depth == depth && pregen->seed == r->v)
+		return;
+	pregendrop();
+
+	Pregen *p = xalloc(1, sizeof(*p));
+	p->depth = depth;
+	p->seed = r->v;
+	p->rng = *r;
+	p->mtx = mtxnew();
+	p->cnd = cndnew();
+	if (!p->mtx || !p->cnd)
+		die("Failed to create the zone pre-generation locks");
+	p->thrd = thrdnew(pregenthrd, p);
+	if (!p->thrd)
+		die("Failed to start the zone pre-generation thread");
+	pregen = p;
+}
+
+void zonepregenstop()
+{
+	pregendrop();
+	pregenreap(1);
+}
+
+// Discards the pre-generated zone, waiting for it if it isn't
+// finished, and frees the given up pre-generations that have
+// finished since.
+static void pregendrop(void)
+{
+	if (pregen)
+		pregenfree(pregen);
+	pregen = NULL;
+	pregenreap(0);
+}
+
+// Frees the given up pre-generations whose workers have finished,
+// or, if wait is true, waits for all of them to finish.
+static void pregenreap(_Bool wait)
+{
+	for (Pregen **pp = &abandoned; *pp; ) {
+		Pregen *p = *pp;
+		mtxlock(p->mtx);
+		_Bool done = p->done;
+		mtxunlock(p->mtx);
+		if (!done && !wait) {
+			pp = &p->next;
+			continue;
+		}
+		*pp = p->next;
+		pregenfree(p);
+	}
+}
+
+static void pregenfree(Pregen *p)
+{
+	thrdjoin(p->thrd);
+	if (p->zone)
+		zonefree(p->zone);
+	cndfree(p->cnd);
+	mtxfree(p->mtx);
+	xfree(p);
+}
+
+static void pregenthrd(void *arg)
+{
+	Pregen *p = arg;
+
+	double t0 = clockms();
+	Zone *z = gen(&p->rng, p->depth);
+	pr("Pre-generated zone %d in %g ms", p->depth, clockms() - t0);
+
+	mtxlock(p->mtx);
+	if (!z)
+		snprintf(p->err, sizeof(p->err), "%s", miderrstr());
+	p->zone = z;
+	p->done = 1;
+	cndbcast(p->cnd);
+	mtxunlock(p->mtx);
+}
+
+// Returns the pre-generated zone for the depth and advances r
+// just as generating it would have.  If no zone was pre-generated
+// from the current state of r, or if it failed or is taking too
+// long, then NULL is returned and the zone must be generated
+// directly.
+static Zone *pregentake(Rng *r, int depth)
+{
+	if (!pregen)
+		return NULL;
+	if (pregen->depth != depth || pregen->seed != r->v) {
+		pregendrop();
+		return NULL;
+	}
+
+	Pregen *p = pregen;
+	double t0 = clockms();
+	mtxlock(p->mtx);
+	while (!p->done && clockms() - t0 < Pregenwait)
+		cndwaitms(p->cnd, p->mtx, Pregenwait - (clockms() - t0));
+	_Bool done = p->done;
+	mtxunlock(p->mtx);
+
+	double wait = clockms() - t0;
+	if (!done) {
+		// The worker can't be stopped, so it's left to finish
+		// and its zone is thrown away.
+		pr("Timed out after %g ms waiting for zone %d to generate", wait, depth);
+		p->next = abandoned;
+		abandoned = p;
+		pregen = NULL;
+		return NULL;
 	}
+	pr("Zone %d handoff waited %g ms", depth, wait);
 
+	if (!p->zone) {
+		pr("Failed to pre-generate zone %d: %s", depth, p->err);
+		pregendrop();
+		return NULL;
+	}
+
+	Zone *z = p->zone;
+	p->zone = NULL;
+	*r = p->rng;
+	pregendrop();
 	return z;
 }
 
+// Generates a zone, taking it from the pool if possible.
+static Zone *gen(Rng *r, int depth)
+{
+	Zone *z = pooltake(r, depth);
+	if (z)
+		return z;
+	return genzone(r, genrecipe(depth));
+}
+
+// Takes a zone for the depth from the pool.  The pool zone's
+// seed is mixed into r, so that the following zones are still
+// determined by the game's Rng and the zones that were taken.
+static Zone *pooltake(Rng *r, int depth)
+{
+	if (depth >= genrecipes())
+		depth = genrecipes() - 1;
+
+	Zone *zn = NULL;
+	unsigned long seed = 0;
+	DIR *d = opendir(pooldir);
+	if (d) {
+		struct dirent *ent;
+		while (!zn && (ent = readdir(d))) {
+			if (poolname(ent->d_name, depth, &seed))
+				zn = poolclaim(ent->d_name);
+		}
+		closedir(d);
+	}
+
+	if (!zn) {
+		poolmisses++;
+		pr("Zone pool miss for depth %d (%d hits, %d misses)", depth, poolhits, poolmisses);
+		return NULL;
+	}
+
+	poolhits++;
+	pr("Zone pool hit for depth %d seed %lu (%d hits, %d misses)", depth, seed, poolhits, poolmisses);
+	rnginit(r, rngint(r) ^ seed);
+	return zn;
+}
+
+// Renames the pool file, so that no other process can take it
+// too, and reads its zone.
+static Zone *poolclaim(const char *name)
+{
+	char path[Bufsz], claimed[Bufsz];
+	snprintf(path, sizeof(path), "%s/%s", pooldir, name);
+	snprintf(claimed, sizeof(claimed), "%s/%s.%d", pooldir, name, (int) getpid());
+	if (rename(path, claimed) < 0)
+		return NULL;
+
+	Zone *zn = NULL;
+	FILE *f = fopen(claimed, "r");
+	if (f) {
+		zn = zoneread(f);
+		fclose(f);
+	}
+	if (!zn)
+		pr("Failed to read the pool zone [%s]: %s", claimed, miderrstr());
+	unlink(claimed);
+	return zn;
+}
+
+// Returns true if name is the name of a pool file for a zone
+// of the given depth, and sets seed to the zone's seed.
+static _Bool poolname(const char *name, int depth, unsigned long *seed)
+{
+	int zd;
+	char ext[8];
+	return sscanf(name, "%d-%lu.%7s", &zd, seed, ext) == 3
+		&& zd == depth && strcmp(ext, "zone") == 0;
+}
+
+// Returns the number of zones in the pool for the depth.
+static int poolcount(int depth)
+{
+	DIR *d = opendir(pooldir);
+	if (!d)
+		return 0;
+
+	int n = 0;
+	unsigned long seed;
+	struct dirent *ent;
+	while ((ent = readdir(d))) {
+		if (poolname(ent->d_name, depth, &seed))
+			n++;
+	}
+	closedir(d);
+	return n;
+}
+
+// Starts zonepool in the background to replace the zones
+// taken from the pool, if the pool for the depth is short.
+static void poolfill(int depth)
+{
+	if (depth >= genrecipes())
+		depth = genrecipes() - 1;
+	if (poolcount(depth) >= Poolsz)
+		return;
+
+	char cmd[Bufsz], num[16];
+	cmdpath(cmd, sizeof(cmd), "zonepool");
+	snprintf(num, sizeof(num), "%d", Poolsz);
+
+	char *argv[] = { cmd, "-n", num, pooldir, NULL };
+	if (spawnbg(argv) < 0)
+		pr("Failed to start zonepool: %s", strerror(errno));
+}
+
+// Zoneget maps the zone file copy-on-write and reads the zone
+// from the mapping, so the level's blocks are used in place and
+// only the pages that the game changes are ever copied.  A zone
+// that hasn't been put since the game was loaded is read from
+// the save instead.
 Zone *zoneget(int znum)
 {
 	ignframetime();
 
+	Zone *zn = cachetake(znum);
+	if (zn)
+		return zn;
+
 	char *zfile = zonefile(znum);
+	if (saved && !fsexists(zfile)) {
+		zn = savefileget(saved, znum);
+		if (!zn)
+			die("Failed to read zone %d from the save: %s", znum, miderrstr());
+		return zn;
+	}
+	unsigned long sz;
+	void *p = mapfile(zfile, &sz);
+	if (p) {
+		zn = zonereadmap(p, sz, unmapfile);
+		if (zn)
+			return zn;
+		// Text and packed zones can't be used in place.
+		unmapfile(p, sz);
+	}
+
 	FILE *f = fopen(zfile, "r");
 	if (!f)
 		die("Unable to open the zone file [%s]: %s", zfile, miderrstr());
 
-	Zone *zn = zoneread(f);
+	zn = zoneread(f);
 	if (!zn)
 		die("Failed to read the zone file [%s]: %s", zfile, miderrstr());
 
@@ -78,19 +481,49 @@ Zone *zoneget(int znum)
 	return zn;
 }
 
+// Zoneput hands the zone to the cache, evicting the least
+// recently used zone if the cache is full.
 void zoneput(Zone *zn, int znum)
 {
 	ignframetime();
 	if (!ensuredir(zonedir))
 		die("Failed to make zone directory: %s", miderrstr());
-	
-	char *zfile = zonefile(znum);
-	FILE *f = fopen(zfile, "w");
-	if (!f)
-		die("Failed to open zone file for writing [%s]: %s", zfile, miderrstr());
+	cachestart();
+
+	mtxlock(cache->mtx);
+	while (cache->n == Maxcached)
+		cndwait(cache->cnd, cache->mtx);
+	cache->ents[cache->n++] = (Cached) { zn, znum, ++cache->tick };
+
+	int live = 0;
+	Cached *lru = NULL;
+	for (int i = 0; i < cache->n; i++) {
+		Cached *e = &cache->ents[i];
+		if (e->evicted)
+			continue;
+		live++;
+		if (!lru || e->used < lru->used)
+			lru = e;
+	}
+	if (live > Cachesz)
+		lru->evicted = 1;
+	cndbcast(cache->cnd);
+	mtxunlock(cache->mtx);
+}
 
-	zonewrite(f, zn);
-	fclose(f);
+Zone *zonecached(int znum)
+{
+	if (!cache)
+		return NULL;
+	// Holding the lock keeps the thread from freeing the zone;
+	// it only reads the zone while writing, as does this.
+	mtxlock(cache->mtx);
+	Zone *zn = NULL;
+	Cached *e = cachefind(znum);
+	if (e && !(zn = zonecopy(e->zn)))
+		die("Failed to copy zone %d: %s", znum, miderrstr());
+	mtxunlock(cache->mtx);
+	return zn;
 }
 
 Tileinfo zonedstairs(Zone *zn)
@@ -111,6 +544,7 @@ Tileinfo zonedstairs(Zone *zn)
 
 void zonecleanup(int zmax)
 {
+	cachestop();
 	for (int i = 0; i <= zmax; i++) {
 		char *zfile = zonefile(i);
 		if (!fsexists(zfile))
@@ -128,232 +562,259 @@ static char *zonefile(int znum)
 	return zfile;
 }
 
-static FILE *zpipe(Rng *r, int depth)
-{
-	Pipe p = {};
-
-	switch(depth){
-	case 0:
-		pipeadd(&p, "lvlgen", "25 25 3 -s %lu ", (unsigned long) rngint(r));
-		pipeadd(&p, "itmgen", "-s %lu %d 1", (unsigned long) rngint(r), ItemStatup);
-		pipeadd(&p, "itmgen", "-s %lu %d %d %d %d %d %d %d %d 50", (unsigned long) rngint(r),
-			ItemCopper, ItemCopper, ItemCopper, ItemCopper, ItemCopper, 
-			ItemSilver, ItemSilver,
-			ItemGold
-		);
-		pipeadd(&p, "itmgen", "-s %lu %d %d %d %d %d 5", (unsigned long) rngint(r),
-			ItemHealth, ItemHealth, ItemHealth, ItemHealth,
-			ItemCarrot
-		);
-		pipeadd(&p, "itmgen", "-s %lu %d %d %d 1", (unsigned long) rngint(r),
-			ItemBubble, ItemZap, ItemLead
-		);
-		pipeadd(&p, "itmgen", "-s %lu %d 1", (unsigned long) rngint(r), ItemHamCan);
-		pipeadd(&p, "envgen", "-s %lu %d 1", (unsigned long) rngint(r), EnvShrempty);
-		pipeadd(&p, "envgen", "-s %lu %d %d %d 2", (unsigned long) rngint(r),
-			EnvSwdStoneHp,
-			EnvSwdStoneDex,
-			EnvSwdStoneStr);
-		pipeadd(&p, "enmgen", "-s %lu %d %d %d %d %d %d %d %d %d %d %d %d 50",
-			(unsigned long) rngint(r),
-			EnemyUnti, EnemyUnti, EnemyUnti,
-			EnemyNous, EnemyNous, EnemyNous, EnemyNous,
-			EnemyDa, EnemyDa, EnemyDa,
-			EnemyThu,
-			EnemyGrendu
-		);
-		break;
-	case 1:
-		pipeadd(&p, "lvlgen", "25 25 3 -s %lu ", (unsigned long) rngint(r));
-		pipeadd(&p, "itmgen", "-s %lu %d 1", (unsigned long) rngint(r), ItemStatup);
-		pipeadd(&p, "itmgen", "-s %lu %d %d %d %d %d %d %d %d 50", (unsigned long) rngint(r),
-			ItemCopper, ItemCopper, ItemCopper, ItemCopper, 
-			ItemSilver, ItemSilver, ItemSilver,
-			ItemGold
-		);
-		pipeadd(&p, "itmgen", "-s %lu %d %d %d %d %d 5", (unsigned long) rngint(r),
-			ItemHealth, ItemHealth, ItemHealth,
-			ItemCarrot, ItemCarrot
-		);
-		pipeadd(&p, "itmgen", "-s %lu %d 1", (unsigned long) rngint(r), ItemHamCan);
-		pipeadd(&p, "envgen", "-s %lu %d 1", (unsigned long) rngint(r), EnvShrempty);
-		pipeadd(&p, "envgen", "-s %lu %d %d %d 2", (unsigned long) rngint(r),
-			EnvSwdStoneHp,
-			EnvSwdStoneDex,
-			EnvSwdStoneStr);
-		pipeadd(&p, "enmgen", "-s %lu %d %d %d %d %d %d %d %d %d %d %d %d 50",
-			(unsigned long) rngint(r),
-			EnemyUnti, EnemyUnti, EnemyUnti,
-			EnemyNous, EnemyNous, EnemyNous,
-			EnemyDa, EnemyDa, EnemyDa,
-			EnemyThu, EnemyThu,
-			EnemyGrendu
-		);
-		break;
-	case 2:
-		pipeadd(&p, "lvlgen", "25 25 3 -s %lu ", (unsigned long) rngint(r));
-		pipeadd(&p, "itmgen", "-s %lu %d 1", (unsigned long) rngint(r), ItemStatup);
-		pipeadd(&p, "itmgen", "-s %lu %d %d %d %d %d %d %d %d 50", (unsigned long) rngint(r),
-			ItemCopper, ItemCopper, ItemCopper, 
-			ItemSilver, ItemSilver, ItemSilver, ItemSilver,
-			ItemGold
-		);
-		pipeadd(&p, "itmgen", "-s %lu %d %d %d %d %d 5", (unsigned long) rngint(r),
-			ItemHealth, ItemHealth,
-			ItemCarrot, ItemCarrot, ItemCarrot
-		);
-		pipeadd(&p, "itmgen", "-s %lu %d 1", (unsigned long) rngint(r), ItemHamCan);
-		pipeadd(&p, "itmgen", "-s %lu %d %d %d 1", (unsigned long) rngint(r),
-			ItemBubble, ItemZap, ItemLead
-		);
-		pipeadd(&p, "envgen", "-s %lu %d 1", (unsigned long) rngint(r), EnvShrempty);
-		pipeadd(&p, "envgen", "-s %lu %d %d %d 2", (unsigned long) rngint(r),
-			EnvSwdStoneHp2,
-			EnvSwdStoneDex2,
-			EnvSwdStoneStr2);
-		pipeadd(&p, "enmgen", "-s %lu %d %d %d %d %d %d %d %d %d %d %d %d 50",
-			(unsigned long) rngint(r),
-			EnemyUnti, EnemyUnti, EnemyUnti,
-			EnemyNous, EnemyNous,
-			EnemyDa, EnemyDa, EnemyDa,
-			EnemyThu, EnemyThu,
-			EnemyGrendu, EnemyGrendu
-		);
-		break;
-	case 3:
-		pipeadd(&p, "lvlgen", "30 30 3 -s %lu ", (unsigned long) rngint(r));
-		pipeadd(&p, "itmgen", "-s %lu %d 1", (unsigned long) rngint(r), ItemStatup);
-		pipeadd(&p, "itmgen", "-s %lu %d %d %d %d %d %d %d %d 50", (unsigned long) rngint(r),
-			ItemCopper, 
-			ItemSilver, ItemSilver, ItemSilver,
-			ItemGold, ItemGold, ItemGold, ItemGold
-		);
-		pipeadd(&p, "itmgen", "-s %lu %d %d %d %d %d 4", (unsigned long) rngint(r),
-			ItemHealth, ItemHealth,
-			ItemCarrot, ItemCarrot
-		);
-		pipeadd(&p, "itmgen", "-s %lu %d 1", (unsigned long) rngint(r), ItemHamCan);
-		pipeadd(&p, "envgen", "-s %lu %d 1", (unsigned long) rngint(r), EnvShrempty);
-		pipeadd(&p, "envgen", "-s %lu %d %d %d 2", (unsigned long) rngint(r),
-			EnvSwdStoneHp2,
-			EnvSwdStoneDex2,
-			EnvSwdStoneStr2);
-		pipeadd(&p, "enmgen", "-s %lu %d %d %d %d %d %d %d %d %d %d %d %d 25",
-			(unsigned long) rngint(r),
-			EnemyUnti, EnemyUnti, EnemyUnti,
-			EnemyNous, EnemyNous,
-			EnemyDa, EnemyDa, EnemyDa,
-			EnemyThu, EnemyThu,
-			EnemyGrendu, EnemyGrendu
-		);
-		pipeadd(&p, "enmgen", "-s %lu %d %d %d 25",
-			(unsigned long) rngint(r),
-			EnemyThu, EnemyThu,
-			EnemyGrendu
-		);
-		break;
-	case 4:
-		pipeadd(&p, "lvlgen", "30 30 4 -s %lu ", (unsigned long) rngint(r));
-		pipeadd(&p, "itmgen", "-s %lu %d 1", (unsigned long) rngint(r), ItemStatup);
-		pipeadd(&p, "itmgen", "-s %lu %d %d %d %d %d %d %d %d 50", (unsigned long) rngint(r),
-			ItemCopper, 
-			ItemSilver, ItemSilver, ItemSilver,
-			ItemGold, ItemGold, ItemGold, ItemGold
-		);
-		pipeadd(&p, "itmgen", "-s %lu %d %d %d %d %d 2", (unsigned long) rngint(r),
-			ItemHealth,
-			ItemCarrot
-		);
-		pipeadd(&p, "itmgen", "-s %lu %d 1", (unsigned long) rngint(r), ItemHamCan);
-		pipeadd(&p, "itmgen", "-s %lu %d %d %d 1", (unsigned long) rngint(r),
-			ItemBubble, ItemZap, ItemLead
-		);
-		pipeadd(&p, "envgen", "-s %lu %d 1", (unsigned long) rngint(r), EnvShrempty);
-		pipeadd(&p, "envgen", "-s %lu %d %d %d 2", (unsigned long) rngint(r),
-			EnvSwdStoneHp3,
-			EnvSwdStoneDex3,
-			EnvSwdStoneStr3);
-		pipeadd(&p, "enmgen", "-s %lu %d %d %d %d %d %d %d %d %d %d %d %d 20",
-			(unsigned long) rngint(r),
-			EnemyUnti, EnemyUnti, EnemyUnti,
-			EnemyNous, EnemyNous,
-			EnemyDa, EnemyDa, EnemyDa,
-			EnemyThu, EnemyThu,
-			EnemyGrendu, EnemyGrendu
-		);
-		pipeadd(&p, "enmgen", "-s %lu %d %d %d %d %d 30",
-			(unsigned long) rngint(r),
-			EnemyThu, EnemyThu,
-			EnemyGrendu, EnemyGrendu,
-			EnemyTihgt
-		);
-		break;
-	default:
-		pipeadd(&p, "lvlgen", "30 30 4 -x -s %lu ", (unsigned long) rngint(r));
-		pipeadd(&p, "itmgen", "-s %lu %d 1", (unsigned long) rngint(r), ItemStatup);
-		pipeadd(&p, "itmgen", "-s %lu %d %d %d %d %d %d %d %d 50", (unsigned long) rngint(r),
-			ItemSilver,
-			ItemGold
-		);
-		pipeadd(&p, "itmgen", "-s %lu %d 1", (unsigned long) rngint(r), ItemHamCan);
-		pipeadd(&p, "envgen", "-s %lu %d 1", (unsigned long) rngint(r), EnvShrempty);
-		pipeadd(&p, "envgen", "-s %lu %d %d %d 2", (unsigned long) rngint(r),
-			EnvSwdStoneHp3,
-			EnvSwdStoneDex3,
-			EnvSwdStoneStr3);
-		pipeadd(&p, "enmgen", "-s %lu %d %d %d %d %d %d %d %d %d %d %d %d 20",
-			(unsigned long) rngint(r),
-			EnemyUnti, EnemyUnti, EnemyUnti,
-			EnemyNous, EnemyNous,
-			EnemyDa, EnemyDa, EnemyDa,
-			EnemyThu, EnemyThu,
-			EnemyGrendu, EnemyGrendu
-		);
-		pipeadd(&p, "enmgen", "-s %lu %d 15",
-			(unsigned long) rngint(r),
-			EnemyTihgt
-		);
-		pipeadd(&p, "enmgen", "-s %lu %d 1",
-			(unsigned long) rngint(r),
-			EnemyHeart
-		);
-		break;
+// Writes the zone to its file in the zone directory.  It writes
+// to a temporary file and renames it over the zone file, because
+// zoneget may have the old file mapped, and truncating it would
+// pull the pages out from under the zone.  It is called from the
+// cache's thread, so it doesn't use zonefile.
+static void writezone(Zone *zn, int znum)
+{
+	char zfile[Bufsz], tmp[Bufsz + 8];
+	snprintf(zfile, sizeof(zfile), "%s/%d.zone", zonedir, znum);
+	snprintf(tmp, sizeof(tmp), "%s.tmp", zfile);
+	FILE *f = fopen(tmp, "w");
+	if (!f)
+		die("Failed to open zone file for writing [%s]: %s", tmp, miderrstr());
+
+	zonewriteb(f, zn);
+	if (fclose(f) != 0)
+		die("Failed to write the zone file [%s]: %s", tmp, miderrstr());
+	// Windows won't rename over an existing file.
+	if (rename(tmp, zfile) != 0 && (remove(zfile) != 0 || rename(tmp, zfile) != 0))
+		die("Failed to rename [%s] to [%s]: %s", tmp, zfile, miderrstr());
+}
+
+static void cachestart(void)
+{
+	if (cache)
+		return;
+	cache = xalloc(1, sizeof(*cache));
+	cache->mtx = mtxnew();
+	cache->cnd = cndnew();
+	if (!cache->mtx || !cache->cnd)
+		die("Failed to create the zone cache locks");
+	cache->thrd = thrdnew(cachethrd, cache);
+	if (!cache->thrd)
+		die("Failed to start the zone cache thread");
+}
+
+// Stops the cache's thread and frees the cached zones without
+// writing those that haven't been.
+static void cachestop(void)
+{
+	if (!cache)
+		return;
+	mtxlock(cache->mtx);
+	cache->quit = 1;
+	cndbcast(cache->cnd);
+	mtxunlock(cache->mtx);
+	thrdjoin(cache->thrd);
+
+	pr("Zone cache: %d hits, %d misses", cache->hits, cache->misses);
+	for (int i = 0; i < cache->n; i++)
+		zonefree(cache->ents[i].zn);
+	cndfree(cache->cnd);
+	mtxfree(cache->mtx);
+	xfree(cache);
+	cache = NULL;
+}
+
+// Must be called with the cache's lock held.
+static Cached *cachefind(int znum)
+{
+	for (int i = 0; i < cache->n; i++) {
+		if (cache->ents[i].znum == znum)
+			return &cache->ents[i];
 	}
+	return NULL;
+}
 
-	char adc[256];
-	if(snprintf(adc, sizeof(adc), "\"%s/cur.lvl\"", zonedir) == -1)
-		die("Failed to create cur.lvl path: %s", miderrstr());
-	pipeadd(&p, "tee", adc);
+// Returns the zone, removing it from the cache, or NULL if it
+// isn't cached.  An evicted zone that hasn't been freed is taken
+// back, since the zone file may not be written yet.
+static Zone *cachetake(int znum)
+{
+	cachestart();
+
+	mtxlock(cache->mtx);
+	Cached *e;
+	while ((e = cachefind(znum)) && e->busy)
+		cndwait(cache->cnd, cache->mtx);
+	Zone *zn = NULL;
+	if (e) {
+		zn = e->zn;
+		*e = cache->ents[--cache->n];
+		cache->hits++;
+	} else {
+		cache->misses++;
+	}
+	cndbcast(cache->cnd);
+	mtxunlock(cache->mtx);
 
-	p.cmd[p.n - 3] = 0;
+	// The zone was left by the stairs.
+	if (zn)
+		zn->updown = Gonone;
+	return zn;
+}
 
-	pr("lvlgen pipeline: [%s]", p.cmd);
+static void cachethrd(void *arg)
+{
+	Zcache *c = arg;
+
+	mtxlock(c->mtx);
+	double last = clockms();
+	while (!c->quit) {
+		_Bool flush = clockms() - last >= Flushms;
+		Cached *e = NULL;
+		for (int i = 0; i < c->n && !e; i++) {
+			Cached *ei = &c->ents[i];
+			if (ei->evicted || (flush && !ei->written))
+				e = ei;
+		}
+		if (!e) {
+			if (flush)
+				last = clockms();
+			cndwaitms(c->cnd, c->mtx, Flushms - (clockms() - last));
+			continue;
+		}
+
+		int znum = e->znum;
+		if (!e->written) {
+			e->busy = 1;
+			Zone *zn = e->zn;
+			mtxunlock(c->mtx);
+
+			double t0 = clockms();
+			writezone(zn, znum);
+			double ms = clockms() - t0;
+
+			mtxlock(c->mtx);
+			// Zones may have been put or taken meanwhile, but not
+			// this one, since it was busy.
+			e = cachefind(znum);
+			e->busy = 0;
+			e->written = 1;
+			pr("Zone %d %s in %g ms", znum, e->evicted ? "evicted" : "flushed", ms);
+		}
+		if (e->evicted) {
+			zonefree(e->zn);
+			*e = c->ents[--c->n];
+		}
+		cndbcast(c->cnd);
+	}
+	mtxunlock(c->mtx);
+}
 
-	FILE *fin = piperead(p.cmd);
-	if (!fin)
-		die("Unable to execute zone gen pipeline: %s", miderrstr());
+// Writes the zone to cur.lvl, just as tee does at the end of the
+// pipeline, so that it can be reproduced with the -p flag.
+static void writecur(Zone *zn)
+{
+	char cur[Bufsz];
+	if (snprintf(cur, sizeof(cur), "%s/cur.lvl", zonedir) == -1)
+		die("Failed to create cur.lvl path: %s", miderrstr());
 
-	return fin;
+	FILE *f = fopen(cur, "w");
+	if (!f) {
+		pr("Failed to open %s for writing: %s", cur, miderrstr());
+		return;
+	}
+	zonewrite(f, zn);
+	fclose(f);
 }
 
-static void pipeadd(Pipe *p, char *cmd, char *fmt, ...)
+static Pipe *zpipe(Rng *r, int depth)
 {
-	char buf[Bufsz];
-	va_list ap;
+	if (depth >= genrecipes())
+		depth = genrecipes() - 1;
+	const Stage *stg = genrecipe(depth)->stages;
+
+	char file[Bufsz], rcp[Bufsz];
+	snprintf(file, sizeof(file), "recipe/%d.rcp", depth);
+	if (!resrcpath(file, rcp, sizeof(rcp)))
+		die("Failed to find the zone recipe: %s", miderrstr());
+
+	char w[16], h[16], d[16], lseed[32], pseed[32], cur[Bufsz];
+	snprintf(w, sizeof(w), "%d", stg->w);
+	snprintf(h, sizeof(h), "%d", stg->h);
+	snprintf(d, sizeof(d), "%d", stg->d);
+	snprintf(lseed, sizeof(lseed), "%lu", (unsigned long) rngint(r));
+	snprintf(pseed, sizeof(pseed), "%lu", (unsigned long) rngint(r));
+	if (snprintf(cur, sizeof(cur), "%s/cur.lvl", zonedir) == -1)
+		die("Failed to create cur.lvl path: %s", miderrstr());
+
+	char *lvlargs[Maxargs] = { w, h, d };
+	int n = 3;
+	if (stg->flags & Lvlnowater)
+		lvlargs[n++] = "-w";
+	if (stg->flags & Lvlrandstart)
+		lvlargs[n++] = "-r";
+	if (stg->flags & Lvlnoexit)
+		lvlargs[n++] = "-x";
+	lvlargs[n++] = "-S";
+	lvlargs[n++] = "-s";
+	lvlargs[n++] = lseed;
+
+	Pipe *p = xalloc(1, sizeof(*p));
+	pipeadd(p, "lvlgen", lvlargs);
+	pipeadd(p, "placegen", (char *[]) { "-s", pseed, rcp, NULL });
+	if (!notee)
+		pipeadd(p, "tee", (char *[]) { cur, NULL });
+
+	for (int i = 0; i < p->n; i++) {
+		char line[Bufsz];
+		int n = 0;
+		for (char **a = p->argv[i]; *a && n < sizeof(line); a++)
+			n += snprintf(line + n, sizeof(line) - n, "%s%s", n > 0 ? " " : "", *a);
+		pr("lvlgen pipeline stage %d: [%s]", i, line);
+	}
 
-	va_start(ap, fmt);
-	int n = vsnprintf(buf, Bufsz, fmt, ap);
-	va_end(ap);
+	p->pl = pipelnopen((char *const **) p->argv, p->n);
+	if (!p->pl)
+		die("Unable to execute zone gen pipeline: %s", miderrstr());
+	return p;
+}
 
-	char cmdbuf[Bufsz];
-	int cmdsz = cmdpath(cmdbuf, Bufsz, cmd);
+// Adds a stage running cmd with the NULL-terminated arguments.
+static void pipeadd(Pipe *p, char *cmd, char *args[])
+{
+	if (p->n == Maxpipe)
+		fatal("Too many pipeline stages");
+
+	int n = 0;
+	while (args[n])
+		n++;
+
+	char path[Bufsz];
+	cmdpath(path, sizeof(path), cmd);
+	char **argv = xalloc(n + 2, sizeof(argv[0]));
+	for (int i = 0; i <= n; i++) {
+		char *a = i == 0 ? path : args[i-1];
+		argv[i] = xalloc(strlen(a) + 1, 1);
+		strcpy(argv[i], a);
+	}
+	p->argv[p->n++] = argv;
+}
 
-	if ((n+4+cmdsz) > Bufsz - p->n)
-		fatal("Buffer is too small");
+// Waits for the pipeline, logs how each stage went, and frees
+// it.  Returns -1 if any stage failed.
+static int pipeclosep(Pipe *p)
+{
+	Pipestat st[Maxpipe];
+	int ret = pipelnclose(p->pl, st);
+
+	double t0 = st[0].start;
+	for (int i = 0; i < p->n; i++) {
+		pr("lvlgen pipeline stage %d (%s): started at %.1f ms, exited with %d "
+			"at %.1f ms, %.1f ms cpu, %lld bytes written",
+			i, p->argv[i][0], st[i].start - t0, st[i].status,
+			st[i].end - t0, st[i].cpums, st[i].bytes);
+	}
 
-	strcat(p->cmd + p->n, cmdbuf);
-	strcat(p->cmd + p->n + cmdsz, " ");
-	strcat(p->cmd + p->n + cmdsz + 1, buf);
-	strcat(p->cmd + p->n + cmdsz + 1 + n, " | ");
-	p->n += n + cmdsz + 4;
+	for (int i = 0; i < p->n; i++) {
+		for (char **a = p->argv[i]; *a; a++)
+			xfree(*a);
+		xfree(p->argv[i]);
+	}
+	xfree(p);
+	return ret;
 }
@@ -0,0 +1,72 @@
+/* © 2013 the Mid Authors under the MIT license. See AUTHORS for the list of authors.*/
+
+#include "../../include/mid.h"
+#include "../../include/log.h"
+#include "../../include/rng.h"
+#include "../../include/gen.h"
+#include <time.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int rng(Rng *, int, char *[]);
+
+// Placegen places all of the items, envs and enemies of a
+// recipe file into the zone read from standard input, in a
+// single pass, and writes the zone to standard output.
+int main(int argc, char *argv[])
+{
+	loginit(NULL);
+
+	int bin = 0;
+	if (argc > 1 && strcmp(argv[1], "-b") == 0) {
+		bin = 1;
+		argc--;
+		argv++;
+	}
+
+	Rng r;
+	int usdargs = rng(&r, argc, argv);
+	argc -= usdargs;
+	argv += usdargs;
+
+	if (argc != 2)
+		fatal("usage: placegen [-b] [-s <seed>] <recipe file>");
+
+	FILE *f = fopen(argv[1], "r");
+	if (!f)
+		fatal("Failed to open %s: %s", argv[1], miderrstr());
+	Recipe rcp;
+	if (!reciperead(f, &rcp))
+		fatal("%s: %s", argv[1], miderrstr());
+	fclose(f);
+
+	Zstrm *zs = zstrmread(stdin, stdout);
+	if (!zs)
+		die("Failed to read the zone: %s", miderrstr());
+	Zone *zn = zs->zn;
+
+	if (!placegen(&r, zn, &rcp))
+		fatal("%s", miderrstr());
+
+	zstrmwrite(zs, stdout, bin ? zonewriteb : zonewrite);
+	zstrmfree(zs);
+
+	return 0;
+}
+
+static int rng(Rng *r, int argc, char *argv[])
+{
+	int args = 0;
+	uint64_t seed = 0;
+
+	if (argc > 2 && strcmp(argv[1], "-s") == 0) {
+		seed = strtoul(argv[2], NULL, 10);
+		args = 2;
+	} else {
+		seed = time(0);
+		pr("placegen seed = %lu", (unsigned long) seed);
+	}
+	rnginit(r, seed);
+
+	return args;
+}
@@ -0,0 +1,156 @@
+/* © 2013 the Mid Authors under the MIT license. See AUTHORS for the list of authors.*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../../include/mid.h"
+#include "../../include/log.h"
+#include "../../include/rng.h"
+#include "../../include/gen.h"
+#include "../../include/os.h"
+#include "../mid/game.h"
+
+enum { Bufsz = 1024 };
+
+static Zone *gen(Rng *);
+static void put(Zone *, int, const char *);
+static void check(const char *, int);
+static void corrupt(const char *);
+static void truncsave(long);
+static void *readall(long *);
+
+static const char *path = "savetest.sav";
+
+// Savetest checks that a save survives a torn header: it writes
+// a save, corrupts the newest header and checks that the save
+// falls back to the one before, that the next save still reads,
+// and that a save with no whole header, or cut short, fails to
+// open instead of being misread.  It exits with failure if any
+// check fails.
+int main(int argc, char *argv[])
+{
+	loginit(NULL);
+	if (argc > 2)
+		fatal("Usage: savetest [<save path>]");
+	if (argc == 2)
+		path = argv[1];
+	remove(path);
+
+	Rng r;
+	rnginit(&r, 1);
+	Zone *zn = gen(&r);
+
+	put(zn, 0, "savetest one");
+	put(zn, 1, "savetest two");
+	check("savetest two", 2);
+
+	corrupt("savetest two");
+	check("savetest one", 1);
+
+	put(zn, 0, "savetest three");
+	check("savetest three", 1);
+
+	remove(path);
+	put(zn, 0, "savetest one");
+	put(zn, 1, "savetest two");
+	corrupt("savetest two");
+	corrupt("savetest one");
+	if (savefileopen(path, 0))
+		fatal("Opened a save with no whole header");
+	pr("No whole header: %s", miderrstr());
+
+	remove(path);
+	put(zn, 0, "savetest one");
+	truncsave(16);
+	if (savefileopen(path, 0))
+		fatal("Opened a truncated save");
+	pr("Truncated: %s", miderrstr());
+
+	zonefree(zn);
+	remove(path);
+	printf("savetest: ok\n");
+	return 0;
+}
+
+static Zone *gen(Rng *r)
+{
+	Lvl *lvl = lvlgen(r, 25, 25, 3, 0);
+	if (!lvl)
+		fatal("Failed to generate the level: %s", miderrstr());
+	return zonenew(lvl);
+}
+
+static void put(Zone *zn, int znum, const char *game)
+{
+	Savefile *sf = savefileopen(path, 1);
+	if (!sf)
+		fatal("Failed to open %s: %s", path, miderrstr());
+	if (!savefileput(sf, &zn, &znum, 1, game))
+		fatal("Failed to save zone %d: %s", znum, miderrstr());
+	savefileclose(sf);
+}
+
+// Checks that the save has the game and zones 0 to nzones-1.
+static void check(const char *game, int nzones)
+{
+	Savefile *sf = savefileopen(path, 0);
+	if (!sf)
+		fatal("Failed to open %s: %s", path, miderrstr());
+	if (strcmp(savefilegame(sf), game) != 0)
+		fatal("Read game [%s], expected [%s]", savefilegame(sf), game);
+	for (int i = 0; i < nzones + 1; i++) {
+		if (savefilehas(sf, i) != (i < nzones))
+			fatal("Zone %d is %sin the save", i, i < nzones ? "not " : "");
+		if (i == nzones)
+			break;
+		Zone *zn = savefileget(sf, i);
+		if (!zn)
+			fatal("Failed to read zone %d: %s", i, miderrstr());
+		zonefree(zn);
+	}
+	savefileclose(sf);
+}
+
+// Flips a byte of the game's state in the header that holds it,
+// as a write of the header cut short by a crash might.
+static void corrupt(const char *game)
+{
+	long sz;
+	char *buf = readall(&sz);
+	size_t n = strlen(game);
+	long i;
+	for (i = 0; i + (long) n <= sz && memcmp(buf + i, game, n + 1) != 0; i++)
+		;
+	if (i + (long) n > sz)
+		fatal("No header with [%s] in %s", game, path);
+
+	FILE *f = fopen(path, "r+b");
+	if (!f || fseek(f, i + n / 2, SEEK_SET) != 0 || fputc(buf[i + n / 2] ^ 0x20, f) == EOF)
+		fatal("Failed to corrupt %s: %s", path, miderrstr());
+	fclose(f);
+	xfree(buf);
+}
+
+// Cuts the save short, leaving only its first sz bytes.
+static void truncsave(long sz)
+{
+	long n;
+	char *buf = readall(&n);
+	FILE *f = fopen(path, "wb");
+	if (!f || fwrite(buf, 1, sz < n ? sz : n, f) != (size_t) (sz < n ? sz : n))
+		fatal("Failed to truncate %s: %s", path, miderrstr());
+	fclose(f);
+	xfree(buf);
+}
+
+static void *readall(long *sz)
+{
+	FILE *f = fopen(path, "rb");
+	if (!f || fseek(f, 0, SEEK_END) != 0 || (*sz = ftell(f)) < 0 || fseek(f, 0, SEEK_SET) != 0)
+		fatal("Failed to read %s: %s", path, miderrstr());
+	char *buf = xalloc(*sz + 1, 1);
+	if (fread(buf, 1, *sz, f) != (size_t) *sz)
+		fatal("Failed to read %s: %s", path, miderrstr());
+	fclose(f);
+	return buf;
+}
@@ -0,0 +1,74 @@
+/* © 2013 the Mid Authors under the MIT license. See AUTHORS for the list of authors.*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+enum { Maxmove = 1 << 20, Bufsz = 4096 };
+
+static int drain(int fd, ssize_t n);
+
+// Splicecopy copies standard input to standard output and to out
+// with tee(2) and splice(2), which move pages between the pipes
+// and the file inside the kernel.  Both standard input and output
+// must be pipes.  It returns -1 if the rest of the copy must be
+// done some other way, 0 on success and 1 on failure.
+int splicecopy(FILE *out){
+	struct stat in, st;
+	if(fstat(0, &in) < 0 || !S_ISFIFO(in.st_mode) || fstat(1, &st) < 0 || !S_ISFIFO(st.st_mode))
+		return -1;
+	int fd = fileno(out);
+
+	for(int first = 1; ; first = 0){
+		// Tee duplicates the data to standard output without
+		// consuming it, and splice then moves it to the file.
+		ssize_t n = tee(0, 1, Maxmove, 0);
+		if(n == 0)
+			return 0;
+		if(n < 0){
+			if(errno == EINTR)
+				continue;
+			return first && errno == EINVAL ? -1 : 1;
+		}
+		while(n > 0){
+			ssize_t m = splice(0, NULL, fd, NULL, n, SPLICE_F_MOVE);
+			if(m < 0 && errno == EINTR)
+				continue;
+			if(m < 0 && errno == EINVAL && first){
+				// Out can't be spliced to, but the data is
+				// already on standard output.
+				return drain(fd, n) < 0 ? 1 : -1;
+			}
+			if(m <= 0)
+				return 1;
+			n -= m;
+		}
+	}
+}
+
+// Drain reads the n bytes left in standard input after tee
+// copied them to standard output, and writes them to fd.
+static int drain(int fd, ssize_t n){
+	char buf[Bufsz];
+	while(n > 0){
+		ssize_t k = read(0, buf, n < Bufsz ? n : Bufsz);
+		if(k < 0 && errno == EINTR)
+			continue;
+		if(k <= 0)
+			return -1;
+		for(ssize_t w = 0; w < k; ){
+			ssize_t m = write(fd, buf + w, k - w);
+			if(m < 0 && errno == EINTR)
+				continue;
+			if(m < 0)
+				return -1;
+			w += m;
+		}
+		n -= k;
+	}
+	return 0;
+}
@@ -2,27 +2,44 @@
 
 #include <stdio.h>
 
-enum { Maxouts = 64 };
-FILE *outs[64];
-char buf[1024];
+enum { Maxouts = 64, Bufsz = 1 << 16 };
+FILE *outs[Maxouts + 1];
+char buf[Bufsz];
+
+int splicecopy(FILE *out);
 
 int main(int argc, char *argv[]){
-	for(int i = 1; i < argc && i < Maxouts; i++){
-		outs[i-1] = fopen(argv[i], "w");
-		if(!outs[i-1]){
+	int n = 0;
+	for(int i = 1; i < argc && n < Maxouts; i++){
+		outs[n] = fopen(argv[i], "wb");
+		if(!outs[n]){
 			perror("Failed to open output");
 			return 1;
 		}
+		n++;
 	}
 
-	while(fgets(buf, sizeof(buf), stdin) != NULL){
-		fputs(buf, stdout);
-		for(FILE **f = outs; *f != NULL; f++)
-			fputs(buf, *f);
+	// With a single output, the pipes may be able to move the
+	// data without it being copied through tee.
+	int ret = n == 1 ? splicecopy(outs[0]) : -1;
+	if(ret == -1){
+		// Zones may be binary, so the input isn't read as lines.
+		size_t k;
+		while((k = fread(buf, 1, sizeof(buf), stdin)) > 0){
+			fwrite(buf, 1, k, stdout);
+			for(FILE **f = outs; *f != NULL; f++)
+				fwrite(buf, 1, k, *f);
+		}
+		ret = ferror(stdin) ? 1 : 0;
 	}
 
-	for(FILE **f = outs; *f != NULL; f++)
-		fclose(*f);
-
-	return 0;
+	for(FILE **f = outs; *f != NULL; f++){
+		if(fclose(*f) != 0)
+			ret = 1;
+	}
+	if(fflush(stdout) != 0)
+		ret = 1;
+	if(ret != 0)
+		perror("tee");
+	return ret;
 }
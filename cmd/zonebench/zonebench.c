@@ -0,0 +1,214 @@
+/* © 2013 the Mid Authors under the MIT license. See AUTHORS for the list of authors.*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../../include/mid.h"
+#include "../../include/log.h"
+#include "../../include/rng.h"
+#include "../../include/gen.h"
+#include "../../include/os.h"
+
+enum { Maxdims = 32, Bufsz = 64 };
+
+/* The number of places on each layer from which blocks are seen. */
+enum { Nvis = 8 };
+
+typedef struct Dims Dims;
+struct Dims {
+	int w, h, d;
+};
+
+/* The time to write and read a zone in one format. */
+typedef struct Fmt Fmt;
+struct Fmt {
+	const char *name;
+	void (*write)(FILE *, Zone *);
+	long bytes;
+	double wrms, rdms;
+};
+
+static int parseargs(int, char *[]);
+static Zone *gen(Dims);
+static Zone *load(const char *);
+static void benchzone(const char *, Zone *);
+static void bench(Zone *, Fmt *);
+
+static Dims defdims[] = {
+	{ 25, 25, 3 },
+	{ 30, 30, 4 },
+	{ 100, 100, 4 },
+	{ 200, 200, 4 },
+	{ 512, 512, 4 },
+};
+
+static Dims dims[Maxdims];
+static int ndims;
+static int num = 10;
+static unsigned long seed = 1;
+
+static const int itms[] = { ItemCopper, ItemSilver, ItemGold, ItemHealth };
+static const int envs[] = { EnvSwdStoneHp, EnvSwdStoneDex, EnvSwdStoneStr };
+static const int enms[] = { EnemyUnti, EnemyNous, EnemyDa, EnemyThu };
+
+// Zonebench generates a zone of each of the given sizes, fills
+// it with items, envs and enemies, and then writes and reads it
+// num times in the text, binary and packed formats, through a
+// temporary file.  With -f it does the same for each of the
+// given zone files instead, such as those in _zones.  For
+// each format it prints the size, the ratio of the binary size
+// to that size, the mean times, and the throughput as megabytes
+// of the binary zone per second.
+int main(int argc, char *argv[])
+{
+	loginit(NULL);
+	int files = parseargs(argc, argv);
+
+	printf("%-14s %-4s %10s %6s %9s %9s %9s %9s\n",
+		"zone", "fmt", "bytes", "ratio", "wr ms", "rd ms", "wr MB/s", "rd MB/s");
+	if (files > 0) {
+		for (int i = files; i < argc; i++) {
+			Zone *zn = load(argv[i]);
+			const char *s = strrchr(argv[i], '/');
+			benchzone(s ? s + 1 : argv[i], zn);
+			zonefree(zn);
+		}
+		return 0;
+	}
+	for (int i = 0; i < ndims; i++) {
+		char name[Bufsz];
+		snprintf(name, sizeof(name), "%dx%dx%d", dims[i].w, dims[i].h, dims[i].d);
+		Zone *zn = gen(dims[i]);
+		benchzone(name, zn);
+		zonefree(zn);
+	}
+
+	return 0;
+}
+
+// Returns the index of the first zone file argument, or 0 if
+// there are none.
+static int parseargs(int argc, char *argv[])
+{
+	int i, files = 0;
+	for (i = 1; i < argc; i++) {
+		if (i < argc - 1 && strcmp("-n", argv[i]) == 0)
+			num = strtol(argv[++i], NULL, 10);
+		else if (i < argc - 1 && strcmp("-s", argv[i]) == 0)
+			seed = strtoul(argv[++i], NULL, 10);
+		else if (i < argc - 1 && strcmp("-f", argv[i]) == 0)
+			files = 1;
+		else
+			break;
+	}
+	if (num < 1)
+		num = 1;
+	if (files)
+		return i;
+
+	for ( ; i + 2 < argc && ndims < Maxdims; i += 3) {
+		dims[ndims++] = (Dims) {
+			strtol(argv[i], NULL, 10),
+			strtol(argv[i+1], NULL, 10),
+			strtol(argv[i+2], NULL, 10),
+		};
+	}
+	if (i < argc)
+		fatal("Usage: zonebench [-n <num>] [-s <seed>] [<w> <h> <d>]... | -f <zone file>...");
+
+	if (ndims == 0) {
+		ndims = sizeof(defdims) / sizeof(defdims[0]);
+		memcpy(dims, defdims, sizeof(defdims));
+	}
+	return 0;
+}
+
+// Generates a zone with about as many things in each layer as
+// a layer can hold, and with the blocks seen from a few places
+// on each layer visible, as in a zone that has been explored, so
+// that the records and the visibility are measured as well as
+// the tiles.
+static Zone *gen(Dims d)
+{
+	Rng r;
+	rnginit(&r, seed);
+	Lvl *lvl = lvlgen(&r, d.w, d.h, d.d, 0);
+	for (lvl->z = 0; lvl->z < lvl->d; lvl->z++) {
+		for (int i = 0; i < Nvis; i++)
+			lvlvis(lvl, rngintincl(&r, 1, lvl->w - 1), rngintincl(&r, 1, lvl->h - 1));
+	}
+	lvl->z = 0;
+	Zone *zn = zonenew(lvl);
+
+	int n = sizeof(itms) / sizeof(itms[0]);
+	if (!itmgen(&r, zn, itms, n, d.d * Maxitms / 2))
+		pr("Not all items were placed: %s", miderrstr());
+	n = sizeof(envs) / sizeof(envs[0]);
+	if (!envgen(&r, zn, envs, n, d.d * Maxenvs / 2))
+		pr("Not all envs were placed: %s", miderrstr());
+	n = sizeof(enms) / sizeof(enms[0]);
+	if (!enmgen(&r, zn, enms, n, d.d * Maxenms / 2))
+		pr("Not all enemies were placed: %s", miderrstr());
+	return zn;
+}
+
+static Zone *load(const char *path)
+{
+	FILE *f = fopen(path, "r");
+	if (!f)
+		fatal("Failed to open %s: %s", path, miderrstr());
+	Zone *zn = zoneread(f);
+	if (!zn)
+		fatal("Failed to read %s: %s", path, miderrstr());
+	fclose(f);
+	return zn;
+}
+
+static void benchzone(const char *name, Zone *zn)
+{
+	Fmt fmts[] = {
+		{ "txt", zonewrite },
+		{ "bin", zonewriteb },
+		{ "pack", zonewritep },
+	};
+	enum { Nfmts = sizeof(fmts) / sizeof(fmts[0]) };
+
+	for (int i = 0; i < Nfmts; i++)
+		bench(zn, &fmts[i]);
+
+	double binmb = fmts[1].bytes / 1e6;
+	for (int i = 0; i < Nfmts; i++) {
+		Fmt *f = &fmts[i];
+		printf("%-14s %-4s %10ld %6.1f %9.3f %9.3f %9.1f %9.1f\n",
+			i == 0 ? name : "", f->name, f->bytes, (double) fmts[1].bytes / f->bytes,
+			f->wrms, f->rdms, binmb / (f->wrms / 1e3), binmb / (f->rdms / 1e3));
+	}
+}
+
+static void bench(Zone *zn, Fmt *fmt)
+{
+	FILE *f = tmpfile();
+	if (!f)
+		fatal("Failed to create a temporary file: %s", miderrstr());
+
+	for (int i = 0; i < num; i++) {
+		rewind(f);
+		double t0 = clockms();
+		fmt->write(f, zn);
+		fflush(f);
+		fmt->wrms += clockms() - t0;
+		fmt->bytes = ftell(f);
+
+		rewind(f);
+		t0 = clockms();
+		Zone *z = zoneread(f);
+		fmt->rdms += clockms() - t0;
+		if (!z)
+			fatal("Failed to read the zone back: %s", miderrstr());
+		zonefree(z);
+	}
+
+	fclose(f);
+	fmt->wrms /= num;
+	fmt->rdms /= num;
+}
@@ -0,0 +1,151 @@
+/* © 2013 the Mid Authors under the MIT license. See AUTHORS for the list of authors.*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "../../include/mid.h"
+#include "../../include/log.h"
+#include "../../include/rng.h"
+#include "../../include/gen.h"
+#include "../../include/os.h"
+
+enum { Bufsz = 1024 };
+
+/* A lock file older than this, in seconds, was left by a
+ * zonepool that didn't exit cleanly. */
+enum { Stalelock = 600 };
+
+static void parseargs(int, char *[]);
+static int count(int depth);
+static void fill(Rng *, int depth);
+static _Bool lock(void);
+static void unlock(void);
+
+static char *dir;
+static int num = 2;
+static char lockfile[Bufsz];
+
+// Zonepool keeps num zones for each recipe in dir, so that mid can
+// take them instead of generating them.  The pool file for a zone
+// generated at a given depth from the Rng initialized with a given
+// seed is named <depth>-<seed>.zone.
+int main(int argc, char *argv[])
+{
+	loginit(NULL);
+	parseargs(argc, argv);
+
+	if (lowprio() < 0)
+		pr("Failed to lower the priority");
+	makedir(dir);
+	if (!genrecipesinit())
+		fatal("Failed to load the recipes: %s", miderrstr());
+	if (!lock())
+		return 0;
+
+	Rng r;
+	rnginit(&r, time(0) ^ getpid() ^ getpid() << 16);
+
+	for (int d = 0; d < genrecipes(); d++) {
+		for (int n = count(d); n < num; n++)
+			fill(&r, d);
+	}
+
+	unlock();
+	return 0;
+}
+
+static void parseargs(int argc, char *argv[])
+{
+	for (int i = 1; i < argc; i++) {
+		if (i < argc - 1 && strcmp("-n", argv[i]) == 0)
+			num = strtol(argv[++i], NULL, 10);
+		else
+			dir = argv[i];
+	}
+	if (!dir)
+		fatal("Usage: zonepool [-n <num>] <dir>");
+}
+
+static int count(int depth)
+{
+	DIR *d = opendir(dir);
+	if (!d)
+		fatal("Failed to open %s: %s", dir, miderrstr());
+
+	int n = 0;
+	struct dirent *ent;
+	while ((ent = readdir(d))) {
+		int zd;
+		unsigned long seed;
+		char ext[8];
+		if (sscanf(ent->d_name, "%d-%lu.%7s", &zd, &seed, ext) == 3
+				&& zd == depth && strcmp(ext, "zone") == 0)
+			n++;
+	}
+	closedir(d);
+	return n;
+}
+
+// Generates a zone and adds it to the pool.  The zone is
+// written to a temporary file first so that mid never sees
+// a partial zone.
+static void fill(Rng *r, int depth)
+{
+	unsigned long seed = rngint(r);
+	Rng zr;
+	rnginit(&zr, seed);
+
+	Zone *zn = genzone(&zr, genrecipe(depth));
+	if (!zn)
+		fatal("Failed to generate a depth %d zone with seed %lu: %s", depth, seed, miderrstr());
+
+	char tmp[Bufsz], path[Bufsz];
+	snprintf(tmp, sizeof(tmp), "%s/%d-%lu.tmp", dir, depth, seed);
+	snprintf(path, sizeof(path), "%s/%d-%lu.zone", dir, depth, seed);
+
+	FILE *f = fopen(tmp, "w");
+	if (!f)
+		fatal("Failed to open %s for writing: %s", tmp, miderrstr());
+	zonewrite(f, zn);
+	zonefree(zn);
+	_Bool failed = ferror(f);
+	if (fclose(f) != 0 || failed) {
+		unlink(tmp);
+		fatal("Failed to write %s: %s", tmp, miderrstr());
+	}
+
+	if (rename(tmp, path) < 0)
+		fatal("Failed to rename %s to %s: %s", tmp, path, miderrstr());
+}
+
+// Only one zonepool fills a directory at a time.  Returns
+// false if another zonepool holds the lock.
+static _Bool lock(void)
+{
+	snprintf(lockfile, sizeof(lockfile), "%s/lock", dir);
+
+	int fd = open(lockfile, O_WRONLY | O_CREAT | O_EXCL, 0600);
+	if (fd < 0) {
+		struct stat sb;
+		if (stat(lockfile, &sb) < 0 || time(0) - sb.st_mtime < Stalelock)
+			return 0;
+		pr("Removing stale lock %s", lockfile);
+		unlink(lockfile);
+		fd = open(lockfile, O_WRONLY | O_CREAT | O_EXCL, 0600);
+		if (fd < 0)
+			return 0;
+	}
+	close(fd);
+	return 1;
+}
+
+static void unlock(void)
+{
+	if (unlink(lockfile) < 0)
+		pr("Failed to remove %s: %s", lockfile, miderrstr());
+}
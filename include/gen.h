@@ -0,0 +1,115 @@
+/* © 2013 the Mid Authors under the MIT license. See AUTHORS for the list of authors.*/
+
+// requires mid.h and rng.h
+
+enum {
+	Lvlnowater = 1 << 0,
+	Lvlrandstart = 1 << 1,
+	Lvlnoexit = 1 << 2,
+};
+
+/* Generates a new level with the given dimensions.  The flags
+ * are a bitwise or of the Lvl* flags above. */
+Lvl *lvlgen(Rng *, int w, int h, int d, unsigned int flags);
+
+/* Statistics of a level generation.  A level is regenerated
+ * until enough of it is reachable, so there may be several
+ * attempts; the times are summed over all of them, and segs
+ * and reach are those of the accepted attempt. */
+typedef struct Lvlstats Lvlstats;
+struct Lvlstats {
+	int attempts;
+	int segs;
+	double reach;	// fraction of the blocks that are reachable
+
+	double ms;
+	double pathms, morereachms, closeunitsms, closeunreachms;
+};
+
+/* Like lvlgen, but also fills in the statistics. */
+Lvl *lvlgenstats(Rng *, int w, int h, int d, unsigned int flags, Lvlstats *);
+
+/* Like lvlgen, but runs k attempts at a time on k threads.
+ * Attempt i is seeded from i and the next integer from the Rng,
+ * and the level of the lowest attempt that succeeds is used, so
+ * the level depends on the Rng but not on k.  The attempts
+ * above it are abandoned as soon as it succeeds.  It is not the
+ * same level that lvlgen would generate. */
+Lvl *lvlgenspec(Rng *, int w, int h, int d, unsigned int flags, int k);
+
+/* Each of these places num things, with IDs chosen at random
+ * from the n IDs in ids, into the zone.  False is returned and
+ * the error string is set if they can't all be placed. */
+_Bool itmgen(Rng *, Zone *, const int ids[], int n, int num);
+_Bool envgen(Rng *, Zone *, const int ids[], int n, int num);
+_Bool enmgen(Rng *, Zone *, const int ids[], int n, int num);
+
+typedef enum Stagety Stagety;
+enum Stagety {
+	Stagenone,
+	Stagelvl,
+	Stageitm,
+	Stageenv,
+	Stageenm,
+};
+
+enum { Maxstages = 16, Maxstageids = 16 };
+
+typedef struct Stage Stage;
+struct Stage {
+	Stagety type;
+
+	/* Stagelvl */
+	int w, h, d;
+	unsigned int flags;
+
+	/* Stageitm, Stageenv and Stageenm.  The IDs are
+	 * terminated by the first zero ID (ItemNone, EnvNone
+	 * or EnemyNone). */
+	int ids[Maxstageids];
+	int num;
+};
+
+/* A recipe is a list of stages, terminated by the first
+ * Stagenone stage.  The first stage must be a Stagelvl. */
+typedef struct Recipe Recipe;
+struct Recipe {
+	Stage stages[Maxstages];
+};
+
+/* Reads a recipe from a file with one stage per line:
+ * 	lvl <w> <h> <d> [nowater] [randstart] [noexit]
+ * 	itm|env|enm <num> <name>...
+ * where the names are the item, env and enemy IDs without
+ * their prefix, e.g. Copper for ItemCopper.  Text after a #
+ * is a comment.  Returns false and sets the error string if
+ * the recipe is malformed. */
+_Bool reciperead(FILE *, Recipe *);
+
+/* Places everything from the item, env and enemy stages of
+ * the recipe into the zone in a single pass.  The candidate
+ * locations are found once and updated as things are placed,
+ * instead of being found again for each stage.  Each stage is
+ * seeded with the next integer from the Rng.  The level stage
+ * is ignored.  Returns false and sets the error string on
+ * failure. */
+_Bool placegen(Rng *, Zone *, const Recipe *);
+
+/* Generates a zone from a recipe.  The level is seeded with
+ * the next integer from the Rng, and placegen with the one
+ * after, so the result is the same as that of the command
+ * pipeline given the same seeds.  Returns NULL and sets the
+ * error string on failure. */
+Zone *genzone(Rng *, const Recipe *);
+
+/* Loads the recipes from resrc/recipe/<depth>.rcp.  It must
+ * be called, after resrcpath can find the resources, before
+ * genrecipe or genrecipes.  Returns false and sets the error
+ * string on failure. */
+_Bool genrecipesinit(void);
+
+/* Returns the recipe for zones at the given depth.  There are
+ * genrecipes() distinct recipes; all depths from genrecipes()-1
+ * on share the last one. */
+const Recipe *genrecipe(int depth);
+int genrecipes(void);
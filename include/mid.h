@@ -240,6 +240,10 @@ void rtabfree(Rtab *);
 void *resrcacq(Rtab *, const char *file, void *aux);
 /* Release a reference to a resource. */
 void resrcrel(Rtab *, const char *file, void *aux);
+/* Finds the path of a resource file that is not kept in a table,
+ * writing it to path, which has room for sz bytes.  Returns false
+ * and sets the error string if the file isn't found. */
+_Bool resrcpath(const char *file, char path[], int sz);
 
 typedef struct Txtinfo Txtinfo;
 struct Txtinfo {
@@ -276,12 +280,38 @@ typedef struct Lvl Lvl;
 struct Lvl {
 	int d, w, h, z;
 	int seenz;
-	Blk blks[];
+	Blk *blks;
+
+	/* If unmap is non-NULL then blks points into the mapsz
+	 * bytes at map, which are released by unmap(map, mapsz)
+	 * when the level is freed. */
+	void *map;
+	unsigned long mapsz;
+	void (*unmap)(void *, unsigned long);
 };
 
 Lvl *lvlnew(int, int, int, int);
 Lvl *lvlread(FILE *);
 void lvlwrite(FILE *, Lvl *);
+/* Read and write the level in binary, as a part of a .zoneb
+ * zone: a header followed by the blocks as they are laid out in
+ * memory. */
+Lvl *lvlreadb(FILE *);
+void lvlwriteb(FILE *, Lvl *);
+/* Like lvlreadb, but reads the level from the sz bytes at p,
+ * pointing its blocks into them instead of copying them, so p
+ * must outlive the level.  *n is set to the number of bytes of
+ * the level. */
+Lvl *lvlreadmem(void *p, unsigned long sz, unsigned long *n);
+/* Read and write the level packed: the header of the binary
+ * level followed by run-length encoded tiles and flags, which
+ * are decoded straight into the blocks. */
+Lvl *lvlreadp(FILE *);
+/* Like lvlreadp, but decodes the level from the sz bytes at p,
+ * which can be freed once it returns.  *n is set to the number
+ * of bytes of the level. */
+Lvl *lvlreadpmem(const void *p, unsigned long sz, unsigned long *n);
+void lvlwritep(FILE *, Lvl *);
 void lvlfree(Lvl *);
 _Bool lvlinit();
 void lvlupdate(Lvl *l);
@@ -321,7 +351,7 @@ Tileinfo lvlmajorblk(Lvl *l, Rect r);
 
 static inline Blk *blk(Lvl *l, int x, int y, int z)
 {
-	return &l->blks[z * l->w * l->h + y * l->w + x];
+	return &l->blks[((size_t) z * l->h + y) * l->w + x];
 }
 
 
@@ -646,6 +676,16 @@ struct Enemy{
 _Bool enemyldresrc(void);
 _Bool enemyinit(Enemy *e, EnemyID id, int x, int y);
 void enemyfree(Enemy*);
+
+enum { Enemyaux = 4 };
+
+/* Stores the state of an enemy that isn't in the Enemy struct,
+ * such as the color of an Unti, into aux, for the fixed-size
+ * enemy records of the binary zone format. */
+void enemyaux(Enemy *, int aux[Enemyaux]);
+/* Makes an enemy from its ID, body, hit points and aux state,
+ * just as enemyscan would from the text format. */
+_Bool enemyload(Enemy *, EnemyID, Body, int hp, const int aux[Enemyaux]);
 void enemyupdate(Enemy*, Player*, Zone*);
 void enemydraw(Enemy*, Gfx*);
 
@@ -693,23 +733,102 @@ enum {
 	Maxitms = 64,
 	Maxenvs = 16,
 	Maxmagics = 32,
-	Maxz = 5,
 };
 
 enum { Gonone, Goup, Godown };
 
+/* The things in a zone are kept per z-layer; each array has one
+ * row for each of the level's lvl->d layers. */
 struct Zone {
 	Lvl *lvl;
 	int updown;
 
-	Item itms[Maxz][Maxitms];
-	Env envs[Maxz][Maxenvs];
-	Enemy enms[Maxz][Maxenms];
-	Magic mags[Maxz][Maxmagics];
-};
-
+	Item (*itms)[Maxitms];
+	Env (*envs)[Maxenvs];
+	Enemy (*enms)[Maxenms];
+	Magic (*mags)[Maxmagics];
+
+	/* For each block of the level, the items, envs and enemies
+	 * added with zoneadd* whose bounding boxes touch it, used
+	 * by zoneoverlap.  Things that have gone away or moved off
+	 * the block are dropped from it when they are next seen. */
+	struct Occ *occ;
+
+	/* The number of steps from the nearest up-stairs to each
+	 * block of the level, or -1, built by the first zonedist
+	 * call and freed with the zone. */
+	int *dist;
+
+	/* Set by zoneupdate, and by the game when it otherwise
+	 * changes the zone, so that saving can skip zones that
+	 * haven't changed since they were last saved.  It is clear in
+	 * a new zone and in one that was just read. */
+	_Bool dirty;
+};
+
+/* Returns a new, empty zone for the level.  The zone takes
+ * ownership of the level. */
+Zone *zonenew(Lvl *);
+/* Returns a copy of the zone's level, items, envs, enemies,
+ * magics and occupied blocks, sharing nothing with the zone, so
+ * that it can be written on another thread while the zone is
+ * played.  Returns NULL on failure. */
+Zone *zonecopy(Zone *);
+/* Reads a zone in either the text format written by zonewrite
+ * or the binary formats written by zonewriteb, zonewritep and
+ * zonewrites, which are told apart by their magic numbers. */
 Zone *zoneread(FILE *);
+/* Reads a binary zone from the sz bytes at p, as mapped by
+ * mapfile, without copying its blocks: the level's blocks point
+ * into p, and zonefree calls unmap(p, sz).  Writes to the blocks
+ * go to p, so p must be writable.  On failure p is left to the
+ * caller. */
+Zone *zonereadmap(void *p, unsigned long sz, void (*unmap)(void *, unsigned long));
+/* Reads a plain or packed binary zone from the sz bytes at p
+ * into a zone of its own, so p can be freed once it returns. */
+Zone *zonereadmem(const void *p, unsigned long sz);
 void zonewrite(FILE *, Zone *z);
+/* Writes the zone in the binary .zoneb format: a magic number
+ * and version, the level as written by lvlwriteb, and then the
+ * items, envs and enemies as fixed-size records in the host's
+ * byte order.  It is several times faster to read and write
+ * than the text format. */
+void zonewriteb(FILE *, Zone *z);
+/* Writes the zone like zonewriteb, but with the level packed by
+ * lvlwritep.  A packed zone is a fraction of the size, which
+ * suits saves, but it can't be read by zonereadmap, only by
+ * zoneread and zonereadmem. */
+void zonewritep(FILE *, Zone *z);
+/* Writes the zone streamed: like zonewriteb, but with each
+ * record tagged and followed by an end tag instead of preceded
+ * by counts, so that stages of a pipeline can append to it. */
+void zonewrites(FILE *, Zone *z);
+
+/* A Zstrm is a zone read by a stage of the generation pipeline.
+ * If the zone is streamed then the stage copies the level and
+ * the records to the next stage as they are read, and appends
+ * only what it adds itself, instead of writing the whole zone
+ * again. */
+typedef struct Zstrm Zstrm;
+struct Zstrm {
+	Zone *zn;
+	/* Where the stream is copied, or NULL if the zone read
+	 * wasn't streamed. */
+	FILE *out;
+	/* Whether each item, env and enemy slot of each layer was
+	 * filled when the zone was read. */
+	unsigned char *had;
+};
+
+/* Reads a zone in any format from in, copying it to out if it is
+ * streamed.  Returns NULL on failure. */
+Zstrm *zstrmread(FILE *in, FILE *out);
+/* Finishes the stream by appending all that was added to the
+ * zone since it was read, or, if it wasn't streamed, writes the
+ * zone to f with write. */
+void zstrmwrite(Zstrm *, FILE *f, void (*write)(FILE *, Zone *));
+/* Frees the Zstrm and its zone. */
+void zstrmfree(Zstrm *);
 void zonefree(Zone *);
 // Zoneadditem returns true if the item was successfully added to the zone.
 // It returns false if either there wasn't a spot for the item or if the item was
@@ -721,11 +840,66 @@ _Bool zoneaddmagic(Zone *zn, int z, Magic);
 void zonedraw(Gfx *g, Zone *zn, Player *p);
 void zoneupdate(Zone *zn, Player *p, Msg *);
 
-/* Fills the array with locations that pass the given predicate. */
-int zonelocs(Zone *, int z, _Bool (*)(Zone *, int, Point), Point [], int);
 _Bool zonehasflags(Zone *zn, int z, Point loc, Point wh, unsigned int f);
 _Bool zoneongrnd(Zone *zn, int z, Point loc, Point wh);
 _Bool zoneoverlap(Zone *zn, int z, Point loc, Point wh);
+/* Returns the number of steps that it takes to walk from the
+ * nearest up-stairs to block pt of layer z, going through the
+ * blocks that don't collide and through doors between layers,
+ * or -1 if the block can't be reached.  The distances of all
+ * blocks are found on the first call and kept with the zone,
+ * so they don't reflect later changes to the level. */
+int zonedist(Zone *, int z, Point pt);
+
+/* A candidate location for placing something in a zone: block pt
+ * of layer z. */
+typedef struct Cand Cand;
+struct Cand {
+	Point pt;
+	int z;
+};
+
+/* Is it ok to place something with width-height wh at pt on layer z? */
+typedef _Bool (*Candok)(Zone *, int z, Point pt, Point wh);
+
+/* The set of locations of a zone where something with a given
+ * footprint can be placed.  The set is built once, then, as
+ * things are placed, candsupdate rechecks only the locations
+ * whose footprint the new thing could overlap. */
+typedef struct Cands Cands;
+struct Cands {
+	Zone *zn;
+	int z0, z1;
+	Point wh;
+	Candok ok;
+
+	/* The candidates, in no particular order. */
+	Cand *cs;
+	int n;
+
+	/* The index in cs of the candidate at each block of layers
+	 * z0 to z1-1, or -1. */
+	int *ind;
+};
+
+/* Returns the set of the locations on layers z0 to z1-1 that
+ * pass ok.  The candidates are in the order of the blocks: by
+ * layer, then by column, then by row. */
+Cands *candsnew(Zone *, int z0, int z1, Point wh, Candok);
+void candsfree(Cands *);
+/* Removes candidate i; the last candidate takes its index. */
+void candsrm(Cands *, int i);
+/* Removes all candidates on layer z. */
+void candsrmz(Cands *, int z);
+_Bool candshas(Cands *, Cand);
+/* Rechecks the candidates on layer z that may be affected by
+ * something with bounding box r having been placed there. */
+void candsupdate(Cands *, int z, Rect r);
+/* Copies the (at most) k candidates with the lowest zonedist
+ * into near, nearest first, and returns how many were copied.
+ * Candidates that can't be reached are left out.  It selects
+ * the k with a heap instead of sorting every candidate. */
+int candsnear(Cands *, Cand near[], int k);
 
 /* Scan a set of fields from a string with the given format.  The
  * format is specified as a string of characters with the following
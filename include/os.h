@@ -4,5 +4,93 @@
 
 FILE *piperead(const char *);
 int pipeclose(FILE*);
+
+/* A Pipeln is a pipeline of programs, each reading the standard
+ * output of the one before it, that is started directly, without
+ * a shell. */
+typedef struct Pipeln Pipeln;
+
+/* What is known of a stage of a Pipeln after it has exited.  The
+ * times are from clockms; end is when the stage exited, or -1 if
+ * that isn't known, and cpums is the processor time that it used.
+ * Status is the exit status, or -1 if it didn't exit normally,
+ * and bytes is how much it wrote, or -1 if that isn't known. */
+typedef struct Pipestat Pipestat;
+struct Pipestat {
+	double start, end, cpums;
+	int status;
+	long long bytes;
+};
+
+/* Starts a pipeline of the n programs argvs[0][0] ... argvs[n-1][0],
+ * each with its NULL-terminated argument vector argvs[i].  Returns
+ * NULL on failure. */
+Pipeln *pipelnopen(char *const *argvs[], int n);
+/* Returns the standard output of the last stage. */
+FILE *pipelnout(Pipeln *);
+/* Closes the output, waits for every stage, and frees the Pipeln.
+ * If st isn't NULL, it gets the Pipestat of each stage.  Returns
+ * -1 if any stage failed. */
+int pipelnclose(Pipeln *, Pipestat st[]);
 int makedir(const char *);
+/* Flushes f and forces what was written to it out to the disk.
+ * Returns -1 on failure. */
+int syncfile(FILE *);
+/* Reads n bytes of f at offset off into buf with a single read
+ * of the underlying file.  f must have no buffered writes, and
+ * it must be seeked before it is next read or written.  Returns
+ * the number of bytes read, or -1 on failure. */
+long readat(FILE *f, void *buf, unsigned long n, long long off);
+/* Renames from to to, replacing to if it exists, so that to is
+ * always either the old or the new file.  On Windows neither may
+ * be open.  Returns -1 on failure. */
+int renameover(const char *from, const char *to);
 const char *appdata(const char *prog);
+
+/* Starts the program argv[0] with the arguments argv, which is
+ * terminated by a NULL pointer, detached from the terminal and
+ * without waiting for it to exit.  It must only be called from
+ * one thread.  Returns -1 on failure, with errno set. */
+int spawnbg(char *const argv[]);
+/* Lowers the scheduling priority of the calling process.
+ * Returns -1 on failure. */
+int lowprio(void);
+
+typedef struct Thrd Thrd;
+typedef struct Mtx Mtx;
+typedef struct Cnd Cnd;
+
+/* Starts a new thread calling f(arg).  Returns NULL on failure. */
+Thrd *thrdnew(void (*f)(void*), void *arg);
+/* Waits for the thread to return and frees it. */
+void thrdjoin(Thrd*);
+
+Mtx *mtxnew(void);
+void mtxfree(Mtx*);
+void mtxlock(Mtx*);
+void mtxunlock(Mtx*);
+
+Cnd *cndnew(void);
+void cndfree(Cnd*);
+void cndwait(Cnd*, Mtx*);
+/* Like cndwait but gives up after ms milliseconds.  Returns
+ * non-zero if the wait timed out.  As with cndwait, the wakeup
+ * may be spurious, so the caller must re-check its condition. */
+int cndwaitms(Cnd*, Mtx*, double ms);
+void cndbcast(Cnd*);
+
+/* Runs f(arg) on a new thread with a stack of stksz bytes, waits
+ * for it to return, and returns the most stack, in bytes, that
+ * it used.  Returns -1 on failure. */
+long stkpeak(void (*f)(void*), void *arg, unsigned long stksz);
+
+/* Returns the time in milliseconds on a monotonic clock. */
+double clockms(void);
+
+/* Maps the file at path into memory copy-on-write, setting *sz
+ * to its size: the pages may be written, but the writes are
+ * private to the process and never reach the file.  The mapping
+ * survives the file being replaced.  Returns NULL on failure. */
+void *mapfile(const char *path, unsigned long *sz);
+/* Unmaps the sz bytes at p that were mapped by mapfile. */
+void unmapfile(void *p, unsigned long sz);
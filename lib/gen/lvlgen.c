@@ -0,0 +1,289 @@
+/* © 2013 the Mid Authors under the MIT license. See AUTHORS for the list of authors.*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <limits.h>
+#include "../../include/mid.h"
+#include "../../include/log.h"
+#include "../../include/rng.h"
+#include "../../include/gen.h"
+#include "../../include/os.h"
+#include "lvlgen.h"
+
+typedef struct Spec Spec;
+
+static Loc start(Rng *, int w, int h, unsigned int);
+static bool attempt(Rng *, Lvl *, Loc, unsigned int, Lvlstats *, bool (*)(void *), void *);
+static void finish(Rng *, Lvl *, Loc, unsigned int);
+static void specthrd(void *);
+static bool specstop(void *);
+static void init(Lvl *l);
+static void stairs(Rng *, Lvl *, unsigned int, unsigned int, bool);
+static int stairlocs(Lvl *, Loc []);
+static void clrflags(Lvl *);
+
+Lvl *lvlgen(Rng *r, int w, int h, int d, unsigned int flags)
+{
+	Lvlstats st;
+	return lvlgenstats(r, w, h, d, flags, &st);
+}
+
+Lvl *lvlgenstats(Rng *r, int w, int h, int d, unsigned int flags, Lvlstats *st)
+{
+	*st = (Lvlstats) {};
+	double t0 = clockms();
+
+	Lvl *lvl = lvlnew(d, w, h, 0);
+	Loc l0 = start(r, w, h, flags);
+	while (!attempt(r, lvl, l0, flags, st, NULL, NULL))
+		;
+	finish(r, lvl, l0, flags);
+
+	st->ms = clockms() - t0;
+	return lvl;
+}
+
+/* The state shared by the threads of lvlgenspec.  Attempts are
+ * handed out in index order, so once attempt best has succeeded
+ * every lower attempt has already been started, and no attempt
+ * above best is worth running. */
+struct Spec {
+	int w, h, d;
+	unsigned int flags;
+	Loc l0;
+	uint64_t seed;
+
+	Mtx *mtx;
+	int next;
+	int best;
+	Lvl *lvl;
+	Rng rng;
+};
+
+/* An attempt of lvlgenspec that can be abandoned. */
+typedef struct Specatt Specatt;
+struct Specatt {
+	Spec *spec;
+	int ind;
+};
+
+Lvl *lvlgenspec(Rng *r, int w, int h, int d, unsigned int flags, int k)
+{
+	Spec sp = {
+		.w = w, .h = h, .d = d,
+		.flags = flags,
+		.best = INT_MAX,
+	};
+	sp.l0 = start(r, w, h, flags);
+	sp.seed = rngint(r);
+	sp.mtx = mtxnew();
+	if (!sp.mtx)
+		fatal("Failed to create a mutex");
+
+	Thrd **thrds = xalloc(k, sizeof(thrds[0]));
+	for (int i = 0; i < k; i++) {
+		thrds[i] = thrdnew(specthrd, &sp);
+		if (!thrds[i])
+			fatal("Failed to start attempt thread %d", i);
+	}
+	for (int i = 0; i < k; i++)
+		thrdjoin(thrds[i]);
+	xfree(thrds);
+	mtxfree(sp.mtx);
+
+	finish(&sp.rng, sp.lvl, sp.l0, flags);
+	return sp.lvl;
+}
+
+static void specthrd(void *arg)
+{
+	Spec *sp = arg;
+
+	for ( ; ; ) {
+		mtxlock(sp->mtx);
+		int i = sp->next;
+		if (i > sp->best) {
+			mtxunlock(sp->mtx);
+			return;
+		}
+		sp->next++;
+		mtxunlock(sp->mtx);
+
+		Rng r;
+		rnginit(&r, sp->seed + i * UINT64_C(0x9E3779B97F4A7C15));
+		Lvl *lvl = lvlnew(sp->d, sp->w, sp->h, 0);
+		Lvlstats st;
+		Specatt att = { sp, i };
+		bool ok = attempt(&r, lvl, sp->l0, sp->flags, &st, specstop, &att);
+
+		mtxlock(sp->mtx);
+		if (ok && i < sp->best) {
+			if (sp->lvl)
+				lvlfree(sp->lvl);
+			sp->best = i;
+			sp->lvl = lvl;
+			sp->rng = r;
+			lvl = NULL;
+		}
+		mtxunlock(sp->mtx);
+		if (lvl)
+			lvlfree(lvl);
+	}
+}
+
+// A lower attempt has already succeeded.
+static bool specstop(void *arg)
+{
+	Specatt *att = arg;
+	mtxlock(att->spec->mtx);
+	bool stop = att->spec->best < att->ind;
+	mtxunlock(att->spec->mtx);
+	return stop;
+}
+
+static Loc start(Rng *r, int w, int h, unsigned int flags)
+{
+	Loc l0 = { 2, 2, 0 };
+	if (flags & Lvlrandstart) {
+		l0.x = rnd(r, 1, w-2);
+		l0.y = rnd(r, 1, h-2);
+	}
+	return l0;
+}
+
+/* Builds the level once, returning true if enough of it is
+ * reachable.  If stop is given and returns true, the attempt is
+ * abandoned and false is returned. */
+static bool attempt(Rng *r, Lvl *lvl, Loc l0, unsigned int flags, Lvlstats *st, bool (*stop)(void *), void *stoparg)
+{
+	st->attempts++;
+	init(lvl);
+	if (!(flags & Lvlnowater))
+		water(r, lvl);
+
+	double t = clockms();
+	Path *p = pathnew(lvl);
+	p->stop = stop;
+	p->stoparg = stoparg;
+	pathbuild(r, lvl, p, l0);
+	st->segs = p->nsegs;
+	pathfree(p);
+	st->pathms += clockms() - t;
+	if (stop && stop(stoparg))
+		return false;
+
+	t = clockms();
+	morereach(lvl);
+	st->morereachms += clockms() - t;
+
+	t = clockms();
+	closeunits(lvl);
+	st->closeunitsms += clockms() - t;
+
+	t = clockms();
+	int nreach = closeunreach(lvl);
+	st->closeunreachms += clockms() - t;
+
+	st->reach = (double) nreach / ((double) lvl->w * lvl->h * lvl->d);
+	return nreach >= lvl->w * lvl->h * lvl->d * 0.40;
+}
+
+static void finish(Rng *r, Lvl *lvl, Loc l0, unsigned int flags)
+{
+	stairs(r, lvl, l0.x, l0.y, flags & Lvlnoexit);
+
+	bool foundstart = false;
+	for (int x = 0; x < lvl->w; x++) {
+	for (int y = 0; y < lvl->h; y++) {
+		if (blk(lvl, x, y, 0)->tile == 'u' || blk(lvl, x, y, 0)->tile == 'U') {
+			foundstart = true;
+			break;
+		}
+	}
+	}
+	assert(foundstart);
+
+	clrflags(lvl);
+}
+
+static void init(Lvl *l)
+{
+	for (int z = 0; z < l->d; z++) {
+	for (int y = 0; y < l->h; y++) {
+	for (int x = 0; x < l->w; x++) {
+		int c = ' ';
+		if (x == 0 || x == l->w - 1 || y == 0 || y == l->h - 1)
+			c = '#';
+		*blk(l, x, y, z) = (Blk) { .tile = c };
+	}
+	}
+	}
+}
+
+unsigned int rnd(Rng *r, int min, int max)
+{
+	return rngintincl(r, min, max);
+}
+
+static void stairs(Rng *r, Lvl *lvl, unsigned int x0, unsigned int y0, bool omitexit)
+{
+	if (tileinfo(lvl, x0, y0, 0).flags & Twater)
+		blk(lvl, x0, y0, 0)->tile = 'U';
+	else
+		blk(lvl, x0, y0, 0)->tile = 'u';
+	setreach(lvl, x0, y0, 0);
+
+	if (omitexit)
+		return;
+
+	Loc *ls = xalloc((size_t) lvl->w * lvl->h * lvl->d, sizeof(*ls));
+	int nls = stairlocs(lvl, ls);
+	if (nls == 0)
+		fatal("No stair locations");
+
+	Loc l = ls[rnd(r, 0, nls - 1)];
+	xfree(ls);
+	if (tileinfo(lvl, l.x, l.y, l.z).flags & Twater)
+		blk(lvl, l.x, l.y, l.z)->tile = 'D';
+	else
+		blk(lvl, l.x, l.y, l.z)->tile = 'd';
+	setreach(lvl, l.x, l.y, l.z);
+}
+
+static int stairlocs(Lvl *lvl, Loc ls[])
+{
+	int nls = 0;
+	for (int z = 0; z < lvl->d; z++)
+	for (int x = 1; x < lvl->w-1; x++)
+	for (int y = 1; y < lvl->h-2; y++) {
+		if (reachable(lvl, x, y, z) &&  tileinfo(lvl, x, y+1, z).flags & Tcollide
+			&& !(tileinfo(lvl, x, y, z).flags & (Tfdoor | Tbdoor | Tup))) {
+			ls[nls] = (Loc){ x, y, z };
+			nls++;
+		}
+	}
+	return nls;
+}
+
+/* The reachability flags are only used during generation.  In a
+ * zone, the block flags hold the visibility. */
+static void clrflags(Lvl *lvl)
+{
+	size_t n = (size_t) lvl->w * lvl->h * lvl->d;
+	for (size_t i = 0; i < n; i++)
+		lvl->blks[i].flags = 0;
+}
+
+bool reachable(Lvl *l, int x, int y, int z)
+{
+	return blk(l, x, y, z)->flags != 0;
+}
+
+void setreach(Lvl *l, int x, int y, int z)
+{
+	blk(l, x, y, z)->flags = 1;
+	if (blk(l, x, y, z)->tile == '.')
+		blk(l, x, y, z)->tile = ' ';
+}
@@ -0,0 +1,134 @@
+/* © 2013 the Mid Authors under the MIT license. See AUTHORS for the list of authors.*/
+
+#include <stdint.h>
+
+struct Blk;
+struct Lvl;
+struct Rng;
+
+unsigned int rnd(struct Rng *, int min, int max);
+
+typedef struct Loc Loc;
+struct Loc {
+	int x, y, z;
+};
+
+/* A packed offset from the start of a move. */
+typedef struct Off Off;
+struct Off {
+	signed char x, y, z;
+};
+
+enum {
+	Mvrev = 1 << 0,
+	Mvwtr = 1 << 1,
+};
+
+enum { Maxblks = 64, Maxdrs = 2, Maxmvrows = 16 };
+
+/* Moves are expanded from their specifications at build time by
+ * mkmvtab; see mkmvtab.c. */
+typedef struct Mv Mv;
+struct Mv {
+	/* Copies of the same move, which give it its weight,
+	 * share an id. */
+	int id;
+	int wt;
+	char flgs;
+	int dx, dy, dz;
+
+	/* Whether the block below the start is blocked. */
+	_Bool strtonblk;
+
+	/* Offsets of the blocks that must be clear, blocked,
+	 * and doors.  The door tiles are in doors. */
+	const Off *clr, *blkd, *door;
+	int nclr, nblkd, ndoor;
+	char doors[Maxdrs];
+
+	/* The bounding box of the move, relative to its start,
+	 * and occupancy masks of its rows.  Row z*h + y, where
+	 * h = max.y - min.y + 1, holds bit x for the block at
+	 * offset (x+min.x, y+min.y, z+min.z). */
+	Loc min, max;
+	int nrows;
+	uint64_t clrmask[Maxmvrows];
+	uint64_t blkdmask[Maxmvrows];
+	uint64_t doormask[Maxmvrows];
+};
+
+/* Bit planes of a level, kept in step with it while the path is
+ * built, so that a move can be tested against a row of the level
+ * with a few word operations.  Bit x of word x/64 of row z*h + y
+ * of a plane is the block (x, y, z).  The bits past the end of a
+ * row are set in the collide and reach planes, so that they
+ * reject moves just as blocks outside of the level do. */
+typedef struct Planes Planes;
+struct Planes {
+	int w, h, d;
+	int nwords;
+	uint64_t *collide, *water, *reach, *door;
+};
+
+void planesinit(Planes *, struct Lvl *);
+void planesfree(Planes *);
+/* Updates the collide, water and door bits of a block from its tile. */
+void planesblk(Planes *, struct Lvl *, int x, int y, int z);
+void planesreach(Planes *, int x, int y, int z);
+
+/* Returns the 64 bits of the plane starting at (x, y, z).  Bits
+ * outside of the level are taken from out. */
+static inline uint64_t planewin(Planes *pl, uint64_t *plane, int x, int y, int z, uint64_t out)
+{
+	if (y < 0 || y >= pl->h || z < 0 || z >= pl->d)
+		return out;
+	uint64_t *r = plane + (z * pl->h + y) * pl->nwords;
+
+	int i = x >= 0 ? x / 64 : -((63 - x) / 64);
+	int sh = x - i * 64;
+	uint64_t lo = i >= 0 && i < pl->nwords ? r[i] : out;
+	if (sh == 0)
+		return lo;
+	uint64_t hi = i + 1 >= 0 && i + 1 < pl->nwords ? r[i+1] : out;
+	return lo >> sh | hi << (64 - sh);
+}
+
+extern const Mv moves[];
+extern const int nmoves;
+extern const Mv wtrmvs[];
+extern const int nwtrmvs;
+
+void mvblit(const Mv *mv, struct Lvl *l, Planes *, Loc l0);
+
+typedef struct Seg Seg;
+struct Seg {
+	Loc l0, l1;;
+	const Mv *mv;
+};
+
+typedef struct Path Path;
+struct Path {
+	int maxsegs, nsegs;
+	Seg *segs;
+	Planes pl;
+
+	/* If stop is non-NULL, pathbuild calls it now and then
+	 * and gives up on the path if it returns true. */
+	_Bool (*stop)(void *);
+	void *stoparg;
+};
+
+Path *pathnew(struct Lvl *);
+void pathfree(Path *);
+void pathbuild(struct Rng *, struct Lvl *lvl, Path *, Loc);
+void pathpr(struct Lvl *, Path *);
+
+_Bool reachable(struct Lvl *, int, int, int);
+void setreach(struct Lvl *, int, int, int);
+
+
+void water(struct Rng *, struct Lvl *);
+
+void morereach(struct Lvl *);
+void closeunits(struct Lvl *);
+int closeunreach(struct Lvl *);	// returns count of reachable blocks
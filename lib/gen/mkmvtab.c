@@ -0,0 +1,558 @@
+/* © 2013 the Mid Authors under the MIT license. See AUTHORS for the list of authors.*/
+
+/* Mkmvtab is run at build time.  It expands the move
+ * specifications below, and their reversed variants, into the
+ * static move tables of mvtab.c, so that lvlgen never parses
+ * them at run time. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "lvlgen.h"
+
+typedef struct Mvspec Mvspec;
+struct Mvspec {
+	int wt;
+	int w, h;
+	char flgs;
+	char *blks;
+};
+
+typedef struct Tab Tab;
+struct Tab {
+	const char *name;
+	int nmoves;
+	Mv mvs[256];
+	/* Indices into offs of the clear, blocked and door
+	 * offsets of each move. */
+	int offs[256][3];
+};
+
+static Mvspec *specrev(Mvspec *s);
+static void addmv(Mvspec *, int id, Tab *);
+static Mv mvmk(Mvspec *, int id);
+static int offsets(Mvspec *, const char *accept, Off o[], int sz);
+static void masks(Mvspec *, Mv *);
+static Loc indloc(Mvspec *, int);
+static void die(const char *);
+static void proffs(const char *, int, const Off [], int);
+static void prmasks(const char *, const uint64_t [], int);
+static void prtab(Tab *);
+
+static const char *strttiles = "s";
+static const char *endtiles = "e";
+static const char *blkdtiles = "#";
+static const char *doortiles = "<>";
+static const char *clrtiles = " es<>";
+
+/*
+Move specification array: any character in strttiles is the start of
+the move, any character in endtiles is the end of the move, anything
+in blkdtiles is a collidable block, characters in doortiles are doors,
+and any character in clrtiles must be clear and is considered reachable.
+Anything else is a wild card (whatever ends up being put there while
+building the path).  If .revable is true then both the inital version
+and the version with the start and end swapped are considered.
+*/
+static Mvspec specs[] = {
+	{ .blks =
+		"####"
+		"s >#"
+		"####"
+
+		"####"
+		"e <#"
+		"####",
+	  .flgs = Mvrev,
+	  .wt = 5, .w = 4, .h = 3 },
+
+	{ .blks =
+		"####"
+		"#> s"
+		"####"
+
+		"####"
+		"#< e"
+		"####",
+	  .flgs = Mvrev,
+	  .wt = 5, .w = 4, .h = 3 },
+
+	{ .blks = 
+		"######"
+		"#    #"
+		"#    #"
+		"s    e"
+		"#    #"
+		"######",
+	  . flgs = Mvrev,
+	  .wt = 2, .w = 6, .h = 6 },
+
+	{ .blks = 
+		"######"
+		"#    #"
+		"#    #"
+		"#    s"
+		"#    #"
+		"##  ##"
+		"  e   ",
+	  .wt = 2, .w = 6, .h = 7 },
+
+	{ .blks = 
+		"######"
+		"#    #"
+		"#    #"
+		"s    #"
+		"#    #"
+		"##  ##"
+		"  e   ",
+	  .wt = 2, .w = 6, .h = 7 },
+
+	{ .blks = 
+		"##s ##"
+		"#    #"
+		"#    #"
+		"#    e"
+		"#    #"
+		"######",
+	  .wt = 2, .w = 6, .h = 6 },
+
+	{ .blks = 
+		"##s ##"
+		"#    #"
+		"#    #"
+		"e    #"
+		"#    #"
+		"######",
+	  .wt = 2, .w = 6, .h = 6 },
+
+	{ .blks = 
+		"#####"
+		"#   #"
+		"#   #"
+		"s   e"
+		"#####",
+	  .flgs = Mvrev,
+	  .wt = 2, .w = 5, .h = 5 },
+
+	{ .blks = 
+		"se"
+		"##",
+	  .wt = 5, .w = 2, .h = 2 },
+
+	{ .blks = 
+		"es"
+		"##",
+	  .flgs = Mvrev,
+	  .wt = 5, .w = 2, .h = 2 },
+
+	{ .blks = 
+		"e s"
+		"###",
+	  .flgs = Mvrev,
+	  .wt = 10, .w = 3, .h = 2 },
+
+	{ .blks = 
+		"e  s"
+		"####",
+	  .flgs = Mvrev,
+	  .wt = 10, .w = 4, .h = 2 },
+
+	{ .blks = 
+		"    ."
+		"     "
+		"s   e"
+		"#...#",
+	  .flgs = Mvrev,
+	  .wt = 10, .w = 5, .h = 4, },
+
+	{ .blks = 
+		" e"
+		"s#"
+		"#.",
+	  .flgs = Mvrev,
+	  .wt = 0, .w = 2, .h = 3 },
+
+	{ .blks = 
+		" e"
+		"s#"
+		"##",
+	  .flgs = Mvrev,
+	  .wt = 5, .w = 2, .h = 3 },
+
+	{ .blks = 
+		"s "
+		"#e"
+		".#",
+	  .flgs = Mvrev,
+	  .wt = 1, .w = 2, .h = 3 },
+
+	{ .blks = 
+		"s "
+		"#e"
+		"##",
+	  .flgs = Mvrev,
+	  .wt = 1, .w = 2, .h = 3 },
+
+	{ .blks = 
+		". ."
+		"  e"
+		"  #"
+		"s.."
+		"#..",
+	  .wt = 10, .w = 3, .h = 5 },
+
+	{ .blks = 
+		". ."
+		"  e"
+		"  #"
+		"s##"
+		"###",
+	  .wt = 5, .w = 3, .h = 5 },
+
+	{ .blks = 
+		"  s"
+		" .#"
+		"e.."
+		"#..",
+	  .wt = 10, .w = 3, .h = 4 },
+
+	{ .blks = 
+		"  s"
+		"  #"
+		"e##"
+		"###",
+	  .wt = 5, .w = 3, .h = 4 },
+
+	{ .blks = 
+		". ."
+		"e  "
+		"#  "
+		"..s"
+		"..#",
+	  .wt = 15, .w = 3, .h = 5 },
+
+	{ .blks = 
+		"s  "
+		"#. "
+		"..e"
+		"..#",
+	  .wt = 15, .w = 3, .h = 4 },
+
+	{ .blks = 
+		"e  "
+		"#  "
+		"##s"
+		"###",
+	  .flgs = Mvrev,
+	  .wt = 5, .w = 3, .h = 4 },
+
+	{ .blks =
+		"s   e"
+		"#####",
+	.flgs = Mvrev | Mvwtr,
+	.wt = 10, .w = 5, .h = 2 },
+
+	{ .blks =
+		" e"
+		" #"
+		" *"
+		" *"
+		"s*"
+		"#*",
+	.flgs = Mvrev | Mvwtr,
+	.wt = 5, .w = 2, .h = 6 },
+
+	{ .blks =
+		"e "
+		"# "
+		"* "
+		"* "
+		"*s"
+		"*#",
+	.flgs = Mvrev | Mvwtr,
+	.wt = 5, .w = 2, .h = 6 },
+
+	{ .blks =
+		"e  "
+		"# *"
+		"# *"
+		"# *"
+		"#s "
+		"##",
+	.flgs = Mvrev | Mvwtr,
+	.wt = 5, .w = 3, .h = 6 },
+
+	{ .blks =
+		"  e"
+		"* #"
+		"* #"
+		"* #"
+		" s#"
+		"###",
+	.flgs = Mvrev | Mvwtr,
+	.wt = 5, .w = 3, .h = 6 },
+
+	{ .blks =
+		"   e"
+		"   #"
+		"   *"
+		"  **"
+		"s***"
+		"#***",
+	.flgs = Mvrev | Mvwtr,
+	.wt = 5, .w = 4, .h = 6 },
+
+	{ .blks =
+		"e   "
+		"#   "
+		"*   "
+		"**  "
+		"***s"
+		"***#",
+	.flgs = Mvrev | Mvwtr,
+	.wt = 5, .w = 4, .h = 6 },
+
+	{ .blks =
+		"####"
+		"#> s"
+		"####"
+
+		"####"
+		"#< e"
+		"####",
+	.flgs = Mvrev | Mvwtr,
+	.wt = 2, .w = 4, .h = 3 },
+
+	{ .blks =
+		"####"
+		"s >#"
+		"####"
+
+		"####"
+		"e <#"
+		"####",
+	.flgs = Mvrev | Mvwtr,
+	.wt = 2, .w = 4, .h = 3 },
+};
+
+static const int Nspecs = sizeof(specs) / sizeof(specs[0]);
+
+static Off offs[1024][Maxblks];
+static int noffs;
+
+static Tab tabs[] = {
+	{ .name = "moves" },
+	{ .name = "wtrmvs" },
+};
+
+int main(void)
+{
+	int id = 0;
+
+	printf("/* Generated by mkmvtab.  Do not edit. */\n\n");
+	printf("#include <stdint.h>\n");
+	printf("#include \"lvlgen.h\"\n\n");
+
+	for (int i = 0; i < Nspecs; i++) {
+		Mvspec *s = specs + i;
+		Tab *t = s->flgs & Mvwtr ? &tabs[1] : &tabs[0];
+		addmv(s, id++, t);
+		if (s->flgs & Mvrev)
+			addmv(specrev(s), id++, t);
+	}
+
+	for (int i = 0; i < sizeof(tabs) / sizeof(tabs[0]); i++)
+		prtab(&tabs[i]);
+
+	return 0;
+}
+
+static Mvspec *specrev(Mvspec *s)
+{
+	Mvspec *rev = malloc(sizeof(*rev));
+	if (!rev)
+		die("out of memory");
+	*rev = *s;
+	rev->blks = malloc(strlen(s->blks)+1);
+	if (!rev->blks)
+		die("out of memory");
+	strcpy(rev->blks, s->blks);
+
+	int si = strcspn(rev->blks, strttiles);
+	int ei = strcspn(rev->blks, endtiles);
+	char tmp = rev->blks[si];
+	rev->blks[si] = rev->blks[ei];
+	rev->blks[ei] = tmp;
+
+	return rev;
+}
+
+/* Adds wt copies of the move to the table.  The copies share
+ * their offset arrays and their id. */
+static void addmv(Mvspec *s, int id, Tab *t)
+{
+	Mv mv = mvmk(s, id);
+	for (int i = 0; i < s->wt; i++) {
+		if (t->nmoves == sizeof(t->mvs) / sizeof(t->mvs[0]))
+			die("too many moves");
+		t->mvs[t->nmoves] = mv;
+		t->offs[t->nmoves][0] = noffs - 3;
+		t->offs[t->nmoves][1] = noffs - 2;
+		t->offs[t->nmoves][2] = noffs - 1;
+		t->nmoves++;
+	}
+}
+
+static Mv mvmk(Mvspec *spec, int id)
+{
+	Loc s = indloc(spec, strcspn(spec->blks, strttiles));
+	Loc e = indloc(spec, strcspn(spec->blks, endtiles));
+
+	Mv mv = (Mv) {
+		.id = id,
+		.wt = spec->wt,
+		.flgs = spec->flgs,
+		.dx = e.x - s.x,
+		.dy = e.y - s.y,
+		.dz = e.z - s.z,
+	};
+
+	if (noffs + 3 > sizeof(offs) / sizeof(offs[0]))
+		die("too many offset arrays");
+	mv.nclr = offsets(spec, clrtiles, offs[noffs++], Maxblks);
+	mv.nblkd = offsets(spec, blkdtiles, offs[noffs++], Maxblks);
+	mv.ndoor = offsets(spec, doortiles, offs[noffs++], Maxdrs);
+
+	const Off *blkd = offs[noffs-2];
+	for (int i = 0; i < mv.nblkd; i++) {
+		if (blkd[i].x == 0 && blkd[i].y == 1)
+			mv.strtonblk = 1;
+	}
+
+	for (int i = 0; i < mv.ndoor; i++) {
+		Off o = offs[noffs-1][i];
+		mv.doors[i] = spec->blks[(o.z + s.z) * spec->w * spec->h + (o.y + s.y) * spec->w + o.x + s.x];
+	}
+
+	masks(spec, &mv);
+
+	return mv;
+}
+
+static int offsets(Mvspec *s, const char *accept, Off o[], int sz)
+{
+	int n = 0;
+	Loc l0 = indloc(s, strcspn(s->blks, strttiles));
+
+	for (int i = 0; i < strlen(s->blks); i++) {
+		if (strchr(accept, s->blks[i]) != NULL) {
+			if (n >= sz)
+				die("offsets: array is too small");
+			Loc cur =  indloc(s, i);
+			o[n] = (Off) { cur.x - l0.x, cur.y - l0.y, cur.z - l0.z };
+			n++;
+		}
+	}
+
+	return n;
+}
+
+/* Computes the bounding box of the move and the occupancy masks
+ * of its rows. */
+static void masks(Mvspec *s, Mv *mv)
+{
+	Loc l0 = indloc(s, strcspn(s->blks, strttiles));
+	// Some specifications leave off the end of their last row.
+	int d = (strlen(s->blks) + s->w * s->h - 1) / (s->w * s->h);
+
+	if (s->w > 64)
+		die("move is too wide for its masks");
+	if (d * s->h > Maxmvrows)
+		die("move has too many rows for its masks");
+
+	mv->min = (Loc) { -l0.x, -l0.y, -l0.z };
+	mv->max = (Loc) { s->w - 1 - l0.x, s->h - 1 - l0.y, d - 1 - l0.z };
+	mv->nrows = d * s->h;
+
+	for (int i = 0; i < strlen(s->blks); i++) {
+		Loc l = indloc(s, i);
+		int row = l.z * s->h + l.y;
+		uint64_t bit = UINT64_C(1) << l.x;
+		if (strchr(clrtiles, s->blks[i]))
+			mv->clrmask[row] |= bit;
+		if (strchr(blkdtiles, s->blks[i]))
+			mv->blkdmask[row] |= bit;
+		if (strchr(doortiles, s->blks[i]))
+			mv->doormask[row] |= bit;
+	}
+}
+
+static Loc indloc(Mvspec *s, int i)
+{
+	int z = i / (s->w * s->h);
+	i %= s->w * s->h;
+	int x = i % s->w;
+	int y = i / s->w;
+	return (Loc) { x, y, z };
+}
+
+static void die(const char *msg)
+{
+	fprintf(stderr, "mkmvtab: %s\n", msg);
+	exit(1);
+}
+
+static void proffs(const char *tab, int i, const Off o[], int n)
+{
+	printf("static const Off %s%d[] = {", tab, i);
+	for (int j = 0; j < n; j++)
+		printf(" { %d, %d, %d },", o[j].x, o[j].y, o[j].z);
+	printf(" { 0 } };\n");
+}
+
+static void prmasks(const char *name, const uint64_t m[], int n)
+{
+	printf("\t\t.%s = {", name);
+	for (int i = 0; i < n; i++)
+		printf(" UINT64_C(0x%llx),", (unsigned long long) m[i]);
+	printf(" },\n");
+}
+
+static void prtab(Tab *t)
+{
+	int printed[sizeof(offs) / sizeof(offs[0])] = { 0 };
+	for (int i = 0; i < t->nmoves; i++) {
+		for (int j = 0; j < 3; j++) {
+			int o = t->offs[i][j];
+			if (printed[o])
+				continue;
+			printed[o] = 1;
+			int n = j == 0 ? t->mvs[i].nclr : j == 1 ? t->mvs[i].nblkd : t->mvs[i].ndoor;
+			proffs("offs", o, offs[o], n);
+		}
+	}
+	printf("\n");
+
+	printf("const Mv %s[] = {\n", t->name);
+	for (int i = 0; i < t->nmoves; i++) {
+		Mv *m = &t->mvs[i];
+		printf("\t{\n");
+		printf("\t\t.id = %d, .wt = %d, .flgs = %d,\n", m->id, m->wt, m->flgs);
+		printf("\t\t.dx = %d, .dy = %d, .dz = %d,\n", m->dx, m->dy, m->dz);
+		printf("\t\t.strtonblk = %d,\n", m->strtonblk);
+		printf("\t\t.clr = offs%d, .nclr = %d,\n", t->offs[i][0], m->nclr);
+		printf("\t\t.blkd = offs%d, .nblkd = %d,\n", t->offs[i][1], m->nblkd);
+		printf("\t\t.door = offs%d, .ndoor = %d,\n", t->offs[i][2], m->ndoor);
+		printf("\t\t.doors = { %d, %d },\n", m->doors[0], m->doors[1]);
+		printf("\t\t.min = { %d, %d, %d }, .max = { %d, %d, %d },\n",
+			m->min.x, m->min.y, m->min.z, m->max.x, m->max.y, m->max.z);
+		printf("\t\t.nrows = %d,\n", m->nrows);
+		prmasks("clrmask", m->clrmask, m->nrows);
+		prmasks("blkdmask", m->blkdmask, m->nrows);
+		prmasks("doormask", m->doormask, m->nrows);
+		printf("\t},\n");
+	}
+	printf("};\n\n");
+	printf("const int n%s = %d;\n\n", t->name, t->nmoves);
+}
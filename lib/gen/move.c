@@ -0,0 +1,44 @@
+/* © 2013 the Mid Authors under the MIT license. See AUTHORS for the list of authors.*/
+
+#include <stdbool.h>
+#include "../../include/mid.h"
+#include "lvlgen.h"
+
+static void blitdoor(Lvl *, Loc, int);
+
+/* The move tables, moves and wtrmvs, are generated from the move
+ * specifications in mkmvtab.c at build time. */
+
+void mvblit(const Mv *mv, Lvl *lvl, Planes *pl, Loc l0)
+{
+	for (int i = 0; i < mv->nclr; i++) {
+		Loc loc = (Loc) { l0.x + mv->clr[i].x, l0.y + mv->clr[i].y, l0.z + mv->clr[i].z };
+		setreach(lvl, loc.x, loc.y, loc.z);
+		planesreach(pl, loc.x, loc.y, loc.z);
+	}
+
+	for (int i = 0; i < mv->nblkd; i++) {
+		Loc loc = (Loc) { l0.x + mv->blkd[i].x, l0.y + mv->blkd[i].y, l0.z + mv->blkd[i].z };
+		if (reachable(lvl, loc.x, loc.y, loc.z))
+			continue;
+		blk(lvl, loc.x, loc.y, loc.z)->tile = '#';
+		planesblk(pl, lvl, loc.x, loc.y, loc.z);
+	}
+
+	for (int i = 0; i < mv->ndoor; i++) {
+		Loc loc = (Loc) { l0.x + mv->door[i].x, l0.y + mv->door[i].y, l0.z + mv->door[i].z };
+		blitdoor(lvl, loc, mv->doors[i]);
+		planesblk(pl, lvl, loc.x, loc.y, loc.z);
+	}
+}
+
+static void blitdoor(Lvl *lvl, Loc l, int door)
+{
+	if (tileinfo(lvl, l.x, l.y, l.z).flags & Twater) {
+		if (door == '<')
+			door = '(';
+		else if (door == '>')
+			door = ')';
+	}
+	blk(lvl, l.x, l.y, l.z)->tile = door;
+}
@@ -0,0 +1,229 @@
+/* © 2013 the Mid Authors under the MIT license. See AUTHORS for the list of authors.*/
+
+#include <assert.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include "../../include/mid.h"
+#include "../../include/log.h"
+#include "../../include/rng.h"
+#include "lvlgen.h"
+
+static int extend(Rng *, const Mv [], int, Lvl *, Path *, Loc);
+static int tryadd(Lvl *l, Path *p, Seg s);
+static Seg segmk(Loc l, const Mv *m);
+static bool segok(Lvl *l, Path *p, Seg s);
+static int mvh(const Mv *);
+static bool segconfl(Path *p, Seg s);
+static bool segclr(Path *p, Seg s);
+static bool segwtrok(Path *p, Seg s);
+static bool doorsok(Path *p, Seg s);
+static bool atstart(Path *p, int x, int y, int z);
+
+Path *pathnew(Lvl *l)
+{
+	Path *p = xalloc(1, sizeof(*p));
+	p->maxsegs = l->w * l->h;
+	p->segs = xalloc(p->maxsegs, sizeof(p->segs[0]));
+	planesinit(&p->pl, l);
+	return p;
+}
+
+void pathfree(Path *p)
+{
+	planesfree(&p->pl);
+	free(p->segs);
+	free(p);
+}
+
+enum { Minbr = 3, Maxbr = 9, Stopevery = 1024 };
+
+/* A location on the path that is still branching. */
+typedef struct Branch Branch;
+struct Branch {
+	Loc loc;
+	unsigned int br, i;
+};
+
+/* Grows the path depth-first from loc, trying a random number of
+ * branches from each new location.  The pending branches are
+ * kept on an explicit stack, which never holds more than one
+ * entry per segment. */
+void pathbuild(Rng *r, Lvl *lvl, Path *p, Loc loc)
+{
+	Branch *stk = xalloc(p->maxsegs + 1, sizeof(stk[0]));
+	int n = 0;
+
+	stk[n++] = (Branch) { loc, rnd(r, Minbr, Maxbr), 0 };
+	for (unsigned int iter = 1; n > 0; iter++) {
+		if (p->stop && iter % Stopevery == 0 && p->stop(p->stoparg))
+			break;
+		Branch *b = &stk[n-1];
+		if (b->i == b->br) {
+			n--;
+			continue;
+		}
+		b->i++;
+
+		int ind = -1;
+		if (tileinfo(lvl, b->loc.x, b->loc.y, b->loc.z).flags & Twater)
+			ind = extend(r, wtrmvs, nwtrmvs, lvl, p, b->loc);
+		if (ind < 0)
+			ind = extend(r, moves, nmoves, lvl, p, b->loc);
+		if (ind >= 0)
+			stk[n++] = (Branch) { p->segs[ind].l1, rnd(r, Minbr, Maxbr), 0 };
+	}
+
+	xfree(stk);
+}
+
+static int extend(Rng *r, const Mv mvs[], int n, Lvl *lvl, Path *p, Loc loc)
+{
+	const Mv *failed = NULL;
+	unsigned int base = rnd(r, 0, n);
+	for (int i = 0; i < n; i++) {
+		const Mv *mv = mvs + ((base + i) % n);
+		// Copies of a move that failed here will fail too.
+		if (failed && mv->id == failed->id)
+			continue;
+		Seg s = segmk(loc, mv);
+		int ind = tryadd(lvl, p, s);
+		if (ind >= 0)
+			return ind;
+		failed = mv;
+	}
+	return -1;
+}
+
+static int tryadd(Lvl *l, Path *p, Seg s)
+{
+	if (p->nsegs == p->maxsegs || !segok(l, p, s))
+		return -1;
+	mvblit(s.mv, l, &p->pl, s.l0);
+
+	p->segs[p->nsegs] = s;
+	p->nsegs++;
+
+	return p->nsegs - 1;
+}
+
+static Seg segmk(Loc l, const Mv *m)
+{
+	Seg s;
+	s.l0 = l;
+	s.l1 = (Loc) { l.x + m->dx, l.y + m->dy, l.z + m->dz };
+	s.mv = m;
+	return s;
+}
+
+static bool segok(Lvl *l, Path *p, Seg s)
+{
+	return (p->nsegs != 0 || s.mv->strtonblk)	// 1st seg must start on a block
+		&& s.l1.x > 0 && s.l1.x < l->w - 1
+		&& s.l1.y > 0 && s.l1.y < l->h - 1
+		&& s.l1.z >= 0 && s.l1.z < l->d
+		&& !reachable(l, s.l1.x, s.l1.y, s.l1.z)	// haven't been there yet.
+		&& segclr(p, s)
+		&& segwtrok(p, s)
+		&& !segconfl(p, s)
+		&& doorsok(p, s);
+}
+
+/* The bit planes are tested one row of the move at a time.  Row
+ * r of a move's masks is at offset (min.x, min.y + r%h, min.z + r/h)
+ * from its start, where h is the height of its bounding box. */
+static int mvh(const Mv *mv)
+{
+	return mv->max.y - mv->min.y + 1;
+}
+
+// Blocks that are blocked by the move must not already be reachable.
+static bool segconfl(Path *p, Seg s)
+{
+	const Mv *mv = s.mv;
+	int h = mvh(mv);
+	int x = s.l0.x + mv->min.x;
+
+	for (int r = 0; r < mv->nrows; r++) {
+		if (!mv->blkdmask[r])
+			continue;
+		int y = s.l0.y + mv->min.y + r % h;
+		int z = s.l0.z + mv->min.z + r / h;
+		if (planewin(&p->pl, p->pl.reach, x, y, z, ~UINT64_C(0)) & mv->blkdmask[r])
+			return true;
+	}
+
+	return false;
+}
+
+static bool doorsok(Path *p, Seg s)
+{
+	const Mv *mv = s.mv;
+	int h = mvh(mv);
+	int x = s.l0.x + mv->min.x;
+
+	for (int r = 0; r < mv->nrows; r++) {
+		if (!mv->doormask[r])
+			continue;
+		int y = s.l0.y + mv->min.y + r % h;
+		int z = s.l0.z + mv->min.z + r / h;
+		if (planewin(&p->pl, p->pl.door, x, y, z, 0) & mv->doormask[r])
+			return false;
+	}
+
+	for (int i = 0; i < mv->ndoor; i++) {
+		Off d = mv->door[i];
+		if (atstart(p, s.l0.x + d.x, s.l0.y + d.y, s.l0.z + d.z))
+			return false;
+	}
+
+	return true;
+}
+
+static bool atstart(Path *p, int x, int y, int z)
+{
+	if (p->nsegs == 0)
+		return 0;
+	return p->segs[0].l0.x == x
+		&& p->segs[0].l0.y == y
+		&& p->segs[0].l0.z == z;
+}
+
+// Blocks that are clear in the move must not collide.
+static bool segclr(Path *p, Seg s)
+{
+	const Mv *mv = s.mv;
+	int h = mvh(mv);
+	int x = s.l0.x + mv->min.x;
+
+	for (int r = 0; r < mv->nrows; r++) {
+		if (!mv->clrmask[r])
+			continue;
+		int y = s.l0.y + mv->min.y + r % h;
+		int z = s.l0.z + mv->min.z + r / h;
+		if (planewin(&p->pl, p->pl.collide, x, y, z, ~UINT64_C(0)) & mv->clrmask[r])
+			return false;
+	}
+
+	return true;
+}
+
+// Water moves need water in the clear blocks of their first z-layer.
+static bool segwtrok(Path *p, Seg s)
+{
+	const Mv *mv = s.mv;
+	if (!(mv->flgs & Mvwtr))
+		return true;
+
+	int h = mvh(mv);
+	int x = s.l0.x + mv->min.x;
+
+	for (int r = 0; r < mv->nrows; r++) {
+		if (!mv->clrmask[r] || mv->min.z + r / h != 0)
+			continue;
+		int y = s.l0.y + mv->min.y + r % h;
+		if (mv->clrmask[r] & ~planewin(&p->pl, p->pl.water, x, y, s.l0.z, 0))
+			return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,269 @@
+/* © 2013 the Mid Authors under the MIT license. See AUTHORS for the list of authors.*/
+
+#include "../../include/mid.h"
+#include "../../include/rng.h"
+#include "../../include/gen.h"
+#include <stdbool.h>
+
+enum { Startx = 2, Starty = 2 };
+
+/* A Placer holds the candidate sets of a zone.  A set is built
+ * the first time that it is needed and is kept up to date with
+ * everything placed after that, so a recipe with many stages
+ * scans the zone once per set instead of once per stage. */
+typedef struct Placer Placer;
+struct Placer {
+	Zone *zn;
+	Cands *itms, *enms;
+
+	/* One candidate set for each env size. */
+	Cands *envs[EnvMax];
+	int nenvs;
+};
+
+static void placerfree(Placer *);
+static void placed(Placer *, int z, Rect);
+static Cands *itmcands(Placer *);
+static Cands *envcands(Placer *, Point);
+static Cands *enmcands(Placer *);
+static bool itms(Placer *, Rng *, const int [], int, int);
+static bool envs(Placer *, Rng *, const int [], int, int);
+static bool enms(Placer *, Rng *, const int [], int, int);
+static int nids(const Stage *);
+static _Bool itmok(Zone *, int, Point, Point);
+static _Bool envok(Zone *, int, Point, Point);
+static _Bool enmok(Zone *, int, Point, Point);
+
+_Bool placegen(Rng *r, Zone *zn, const Recipe *rcp)
+{
+	Placer p = { .zn = zn };
+	bool ok = true;
+
+	for (int i = 0; ok && i < Maxstages && rcp->stages[i].type != Stagenone; i++) {
+		const Stage *stg = rcp->stages + i;
+
+		Rng sr;
+		rnginit(&sr, rngint(r));
+
+		switch (stg->type) {
+		case Stagelvl:
+			break;
+		case Stageitm:
+			ok = itms(&p, &sr, stg->ids, nids(stg), stg->num);
+			break;
+		case Stageenv:
+			ok = envs(&p, &sr, stg->ids, nids(stg), stg->num);
+			break;
+		case Stageenm:
+			ok = enms(&p, &sr, stg->ids, nids(stg), stg->num);
+			break;
+		default:
+			seterrstr("Stage %d: unknown stage type %d", i, stg->type);
+			ok = false;
+		}
+	}
+
+	placerfree(&p);
+	return ok;
+}
+
+_Bool itmgen(Rng *r, Zone *zn, const int ids[], int n, int num)
+{
+	Placer p = { .zn = zn };
+	bool ok = itms(&p, r, ids, n, num);
+	placerfree(&p);
+	return ok;
+}
+
+_Bool envgen(Rng *r, Zone *zn, const int ids[], int n, int num)
+{
+	Placer p = { .zn = zn };
+	bool ok = envs(&p, r, ids, n, num);
+	placerfree(&p);
+	return ok;
+}
+
+_Bool enmgen(Rng *r, Zone *zn, const int ids[], int n, int num)
+{
+	Placer p = { .zn = zn };
+	bool ok = enms(&p, r, ids, n, num);
+	placerfree(&p);
+	return ok;
+}
+
+static void placerfree(Placer *p)
+{
+	if (p->itms)
+		candsfree(p->itms);
+	if (p->enms)
+		candsfree(p->enms);
+	for (int i = 0; i < p->nenvs; i++)
+		candsfree(p->envs[i]);
+}
+
+// Rechecks the candidates of every set near something that
+// was just placed.
+static void placed(Placer *p, int z, Rect r)
+{
+	if (p->itms)
+		candsupdate(p->itms, z, r);
+	if (p->enms)
+		candsupdate(p->enms, z, r);
+	for (int i = 0; i < p->nenvs; i++)
+		candsupdate(p->envs[i], z, r);
+}
+
+static Cands *itmcands(Placer *p)
+{
+	if (!p->itms)
+		p->itms = candsnew(p->zn, 0, p->zn->lvl->d, (Point) { Twidth, Theight }, itmok);
+	return p->itms;
+}
+
+// Returns the candidate set for envs of size wh, building it if needed.
+static Cands *envcands(Placer *p, Point wh)
+{
+	for (int i = 0; i < p->nenvs; i++) {
+		if (p->envs[i]->wh.x == wh.x && p->envs[i]->wh.y == wh.y)
+			return p->envs[i];
+	}
+	p->envs[p->nenvs] = candsnew(p->zn, 0, p->zn->lvl->d, wh, envok);
+	return p->envs[p->nenvs++];
+}
+
+static Cands *enmcands(Placer *p)
+{
+	if (!p->enms)
+		p->enms = candsnew(p->zn, 0, p->zn->lvl->d, (Point) { Twidth, Theight }, enmok);
+	return p->enms;
+}
+
+static bool itms(Placer *p, Rng *r, const int ids[], int n, int num)
+{
+	Cands *cs = itmcands(p);
+
+	int i;
+	for (i = 0; i < num && cs->n > 0; i++) {
+		int idind = rngintincl(r, 0, n);
+		int lind = rngintincl(r, 0, cs->n);
+		Cand l = cs->cs[lind];
+		candsrm(cs, lind);
+		Item it = {};
+		if (!iteminit(&it, ids[idind], l.pt)) {
+			seterrstr("Failed to initialize item with ID: %d", ids[idind]);
+			return false;
+		}
+		if (!zoneadditem(p->zn, l.z, it)) {
+			/* oops, this z-layer is full. */
+			candsrmz(cs, l.z);
+			num--;
+			continue;
+		}
+		placed(p, l.z, it.body.bbox);
+	}
+
+	if (i < num) {
+		seterrstr("Failed to place all items");
+		return false;
+	}
+	return true;
+}
+
+static bool envs(Placer *p, Rng *r, const int ids[], int n, int num)
+{
+	for (int i = 0; i < num; i++) {
+		int id = ids[rngintincl(r, 0, n)];
+		Cands *cs = envcands(p, envsize(id));
+		if (cs->n == 0) {
+			seterrstr("No location available to place env ID: %d", id);
+			return false;
+		}
+
+		int lind = rngintincl(r, 0, cs->n);
+		Cand l = cs->cs[lind];
+		candsrm(cs, lind);
+		Env env = {};
+		if (!envinit(&env, id, l.pt)) {
+			seterrstr("Failed to initialize env with ID: %d", id);
+			return false;
+		}
+		if (!zoneaddenv(p->zn, l.z, env)) {
+			for (int j = 0; j < p->nenvs; j++)
+				candsrmz(p->envs[j], l.z);
+			num--;
+			continue;
+		}
+		placed(p, l.z, env.body.bbox);
+	}
+	return true;
+}
+
+static bool enms(Placer *p, Rng *r, const int ids[], int n, int num)
+{
+	Cands *cs = enmcands(p);
+
+	int i;
+	for (i = 0; i < num && cs->n > 0; i++) {
+		int idind = rngintincl(r, 0, n);
+		int lind = rngintincl(r, 0, cs->n);
+		Cand l = cs->cs[lind];
+		candsrm(cs, lind);
+		Enemy enm = {};
+		if (!enemyinit(&enm, ids[idind], l.pt.x, l.pt.y)) {
+			seterrstr("Failed to initialize enemy with ID: %d", ids[idind]);
+			return false;
+		}
+		if (!zoneaddenemy(p->zn, l.z, enm)) {
+			candsrmz(cs, l.z);
+			num--;
+			continue;
+		}
+		placed(p, l.z, enm.body.bbox);
+	}
+
+	if (i < num) {
+		seterrstr("Failed to place all enemies");
+		return false;
+	}
+	return true;
+}
+
+static int nids(const Stage *stg)
+{
+	int n = 0;
+	while (n < Maxstageids && stg->ids[n] != 0)
+		n++;
+	return n;
+}
+
+static _Bool itmok(Zone *zn, int z, Point pt, Point wh)
+{
+	return (pt.x != Startx || pt.y != Starty)
+		&& zoneongrnd(zn, z, pt, wh)
+		&& !zonehasflags(zn, z, pt, wh, Tcollide)
+		&& !zoneoverlap(zn, z, pt, wh);
+}
+
+static _Bool envok(Zone *zn, int z, Point pt, Point wh)
+{
+	Rect start = (Rect) { (Point) { Startx * Twidth, Starty * Theight },
+		(Point) { (Startx+1) * Twidth, (Starty+1) * Theight } };
+	Rect r = (Rect) { (Point) { pt.x * Twidth, pt.y * Theight },
+		(Point) { pt.x * Twidth + wh.x, pt.y * Theight + wh.y } };
+	return !isect(start, r)
+		&& !zonehasflags(zn, z, pt, wh, Tcollide | Tbdoor | Tfdoor | Tdown)
+		&& zoneongrnd(zn, z, pt, wh)
+		&& !zoneoverlap(zn, z, pt, wh);
+}
+
+static _Bool enmok(Zone *zn, int z, Point pt, Point wh)
+{
+	int doorrad = 2;
+	return (pt.x != Startx || pt.y != Starty)
+		&& !zonehasflags(zn, z, pt, wh, Tcollide)
+		&& !zonehasflags(zn, z, (Point) { pt.x - doorrad, pt.y },
+			(Point) { 2 * doorrad * Twidth, Theight },
+			Tfdoor | Tbdoor | Tup)
+		&& zoneongrnd(zn, z, pt, wh)
+		&& !zoneoverlap(zn, z, pt, wh);
+}
@@ -0,0 +1,73 @@
+/* © 2013 the Mid Authors under the MIT license. See AUTHORS for the list of authors.*/
+
+#include "../../include/mid.h"
+#include "lvlgen.h"
+
+enum { Doorflags = Tfdoor | Tbdoor | Tup | Tdown };
+
+static uint64_t *row(Planes *, uint64_t *, int y, int z);
+static void set(Planes *, uint64_t *, int x, int y, int z, _Bool);
+
+void planesinit(Planes *pl, Lvl *lvl)
+{
+	pl->w = lvl->w;
+	pl->h = lvl->h;
+	pl->d = lvl->d;
+	pl->nwords = (lvl->w + 63) / 64;
+
+	int n = pl->nwords * lvl->h * lvl->d;
+	pl->collide = xalloc(n, sizeof(uint64_t));
+	pl->water = xalloc(n, sizeof(uint64_t));
+	pl->reach = xalloc(n, sizeof(uint64_t));
+	pl->door = xalloc(n, sizeof(uint64_t));
+
+	for (int z = 0; z < lvl->d; z++) {
+	for (int y = 0; y < lvl->h; y++) {
+		for (int x = lvl->w; x < pl->nwords * 64; x++) {
+			set(pl, pl->collide, x, y, z, 1);
+			set(pl, pl->reach, x, y, z, 1);
+		}
+		for (int x = 0; x < lvl->w; x++) {
+			planesblk(pl, lvl, x, y, z);
+			if (reachable(lvl, x, y, z))
+				planesreach(pl, x, y, z);
+		}
+	}
+	}
+}
+
+void planesfree(Planes *pl)
+{
+	xfree(pl->collide);
+	xfree(pl->water);
+	xfree(pl->reach);
+	xfree(pl->door);
+}
+
+void planesblk(Planes *pl, Lvl *lvl, int x, int y, int z)
+{
+	unsigned int f = tileinfo(lvl, x, y, z).flags;
+	set(pl, pl->collide, x, y, z, f & Tcollide);
+	set(pl, pl->water, x, y, z, f & Twater);
+	set(pl, pl->door, x, y, z, f & Doorflags);
+}
+
+void planesreach(Planes *pl, int x, int y, int z)
+{
+	set(pl, pl->reach, x, y, z, 1);
+}
+
+static uint64_t *row(Planes *pl, uint64_t *plane, int y, int z)
+{
+	return plane + (z * pl->h + y) * pl->nwords;
+}
+
+static void set(Planes *pl, uint64_t *plane, int x, int y, int z, _Bool v)
+{
+	uint64_t bit = UINT64_C(1) << (x % 64);
+	uint64_t *w = row(pl, plane, y, z) + x / 64;
+	if (v)
+		*w |= bit;
+	else
+		*w &= ~bit;
+}
@@ -6,56 +6,75 @@
 /* You can jump up 2. */
 enum { Uplim = 2 };
 
-static void expndreach(Lvl *lvl, int x, int y, int z);
-static void reach(Lvl *lvl, int x, int y, int z);
-static void reachup(Lvl *lvl, int x, int y, int z);
-static void reachover(Lvl *lvl, int x, int y, int z);
+/* Blocks waiting to be expanded.  Each block is added at most
+ * once, when it becomes reachable, so the reachability flags
+ * double as the visited set. */
+typedef struct Queue Queue;
+struct Queue {
+	Loc *ls;
+	int hd, tl;
+};
 
+static void expndreach(Lvl *lvl, Queue *q, Loc l);
+static void reach(Lvl *lvl, Queue *q, int x, int y, int z);
+static void reachup(Lvl *lvl, Queue *q, int x, int y, int z);
+static void reachover(Lvl *lvl, Queue *q, int x, int y, int z);
+
+/* Expands the reachable blocks breadth-first.  The reachable
+ * set is a fixed point, so the order in which it is found
+ * doesn't change the result. */
 void morereach(Lvl *lvl)
 {
+	Queue q = { .ls = xalloc((size_t) lvl->w * lvl->h * lvl->d, sizeof(Loc)) };
+
 	for (int z = 0; z < lvl->d; z++) {
 	for (int x = 1; x < lvl->w - 1; x++) {
 	for (int y = 1; y < lvl->h - 1; y++) {
 		if (reachable(lvl, x, y, z))
-			expndreach(lvl, x, y, z);
+			q.ls[q.tl++] = (Loc) { x, y, z };
 	}
 	}
 	}
+
+	while (q.hd < q.tl)
+		expndreach(lvl, &q, q.ls[q.hd++]);
+
+	xfree(q.ls);
 }
 
-static void expndreach(Lvl *lvl, int x, int y, int z)
+static void expndreach(Lvl *lvl, Queue *q, Loc l)
 {
-	Tileinfo tundr = tileinfo(lvl, x, y+1, z);
+	Tileinfo tundr = tileinfo(lvl, l.x, l.y+1, l.z);
 	if (tundr.flags & Tcollide) {
-		reachup(lvl, x, y, z);
-		reachover(lvl, x, y, z);
+		reachup(lvl, q, l.x, l.y, l.z);
+		reachover(lvl, q, l.x, l.y, l.z);
 	}
 }
 
-static void reach(Lvl *lvl, int x, int y, int z)
+static void reach(Lvl *lvl, Queue *q, int x, int y, int z)
 {
 	if (tileinfo(lvl, x, y, z).flags & Tcollide || reachable(lvl, x, y, z))
 		return;
 	setreach(lvl, x, y, z);
-	expndreach(lvl, x, y, z);
+	q->ls[q->tl++] = (Loc) { x, y, z };
 }
 
-static void reachup(Lvl *lvl, int x, int y, int z)
+static void reachup(Lvl *lvl, Queue *q, int x, int y, int z)
 {
 	for (int yy = y; yy >= y - Uplim && yy > 0; yy--) {
 		Tileinfo ti = tileinfo(lvl, x, yy, z);
 		if (ti.flags & Tcollide)
 			return;
-		reach(lvl, x, yy, z);
-		reach(lvl, x-1, yy, z);
-		reach(lvl, x+1, yy, z);
+		reach(lvl, q, x, yy, z);
+		reach(lvl, q, x-1, yy, z);
+		reach(lvl, q, x+1, yy, z);
 	}
 }
 
-static void reachover(Lvl *lvl, int x, int y, int z)
+static void reachover(Lvl *lvl, Queue *q, int x, int y, int z)
 {
-	reach(lvl, x-1, y, z);
-	reach(lvl, x+1, y, z);
+	reach(lvl, q, x-1, y, z);
+	reach(lvl, q, x+1, y, z);
 }
 
 /* Fill in single block dips in the ground.  This cannot hurt
@@ -0,0 +1,262 @@
+/* © 2013 the Mid Authors under the MIT license. See AUTHORS for the list of authors.*/
+
+#include "../../include/mid.h"
+#include "../../include/rng.h"
+#include "../../include/gen.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+enum { Maxrecipes = 64, Bufsz = 1024, Pathsz = 4097 };
+
+static bool stageread(char *, Stage *);
+static int lookup(const char *const [], int, const char *);
+
+static const char *const itmnames[] = {
+	[ItemStatup] = "Statup",
+	[ItemCopper] = "Copper",
+	[ItemHealth] = "Health",
+	[ItemSilver] = "Silver",
+	[ItemGold] = "Gold",
+	[ItemCarrot] = "Carrot",
+	[ItemHamCan] = "HamCan",
+	[ItemTopHat] = "TopHat",
+	[ItemSilkGlove] = "SilkGlove",
+	[ItemNavyBlazer] = "NavyBlazer",
+	[ItemFineShoe] = "FineShoe",
+	[ItemIronHelm] = "IronHelm",
+	[ItemIronGlove] = "IronGlove",
+	[ItemIronBody] = "IronBody",
+	[ItemIronBoot] = "IronBoot",
+	[ItemSteelHelm] = "SteelHelm",
+	[ItemSteelGlove] = "SteelGlove",
+	[ItemSteelBody] = "SteelBody",
+	[ItemSteelBoot] = "SteelBoot",
+	[ItemGoldHelm] = "GoldHelm",
+	[ItemGoldGlove] = "GoldGlove",
+	[ItemGoldBody] = "GoldBody",
+	[ItemGoldBoot] = "GoldBoot",
+	[ItemRockHelm] = "RockHelm",
+	[ItemRockGlove] = "RockGlove",
+	[ItemRockBody] = "RockBody",
+	[ItemRockBoot] = "RockBoot",
+	[ItemLavaHelm] = "LavaHelm",
+	[ItemLavaGlove] = "LavaGlove",
+	[ItemLavaBody] = "LavaBody",
+	[ItemLavaBoot] = "LavaBoot",
+	[ItemPlotHelm] = "PlotHelm",
+	[ItemPlotGlove] = "PlotGlove",
+	[ItemPlotBody] = "PlotBody",
+	[ItemPlotBoot] = "PlotBoot",
+	[ItemBubble] = "Bubble",
+	[ItemZap] = "Zap",
+	[ItemLead] = "Lead",
+	[ItemMax] = NULL,
+};
+
+static const char *const envnames[] = {
+	[EnvShrempty] = "Shrempty",
+	[EnvShrused] = "Shrused",
+	[EnvSwdStoneHp] = "SwdStoneHp",
+	[EnvSwdStoneDex] = "SwdStoneDex",
+	[EnvSwdStoneStr] = "SwdStoneStr",
+	[EnvSwdStoneHp2] = "SwdStoneHp2",
+	[EnvSwdStoneDex2] = "SwdStoneDex2",
+	[EnvSwdStoneStr2] = "SwdStoneStr2",
+	[EnvSwdStoneHp3] = "SwdStoneHp3",
+	[EnvSwdStoneDex3] = "SwdStoneDex3",
+	[EnvSwdStoneStr3] = "SwdStoneStr3",
+	[EnvMax] = NULL,
+};
+
+static const char *const enmnames[] = {
+	[EnemyUnti] = "Unti",
+	[EnemyNous] = "Nous",
+	[EnemyDa] = "Da",
+	[EnemyThu] = "Thu",
+	[EnemyGrendu] = "Grendu",
+	[EnemyTihgt] = "Tihgt",
+	[EnemySplat] = "Splat",
+	[EnemyHeart] = "Heart",
+	[EnemyMax] = NULL,
+};
+
+/* Recipes for each depth, read from resrc/recipe/<depth>.rcp.
+ * The last recipe is used for all deeper depths. */
+static Recipe recipes[Maxrecipes];
+static int nrecipes;
+
+bool genrecipesinit(void)
+{
+	if (nrecipes > 0)
+		return true;
+
+	int n;
+	for (n = 0; n < Maxrecipes; n++) {
+		char file[Bufsz], path[Pathsz];
+		snprintf(file, sizeof(file), "recipe/%d.rcp", n);
+		if (!resrcpath(file, path, sizeof(path)))
+			break;
+
+		FILE *f = fopen(path, "r");
+		if (!f) {
+			seterrstr("Failed to open %s", path);
+			return false;
+		}
+		bool ok = reciperead(f, &recipes[n]);
+		fclose(f);
+		if (!ok) {
+			char err[Bufsz];
+			snprintf(err, sizeof(err), "%s", miderrstr());
+			seterrstr("%s: %s", path, err);
+			return false;
+		}
+	}
+	if (n == 0) {
+		seterrstr("No recipes found");
+		return false;
+	}
+
+	nrecipes = n;
+	return true;
+}
+
+const Recipe *genrecipe(int depth)
+{
+	if (depth >= nrecipes)
+		depth = nrecipes - 1;
+	return &recipes[depth];
+}
+
+int genrecipes(void)
+{
+	return nrecipes;
+}
+
+bool reciperead(FILE *f, Recipe *rcp)
+{
+	*rcp = (Recipe) {};
+
+	char buf[Bufsz];
+	int n = 0;
+	for (int lineno = 1; fgets(buf, sizeof(buf), f); lineno++) {
+		char *c = strchr(buf, '#');
+		if (c)
+			*c = '\0';
+		if (strspn(buf, " \t\r\n") == strlen(buf))
+			continue;
+
+		if (n == Maxstages) {
+			seterrstr("Line %d: too many stages", lineno);
+			return false;
+		}
+		Stage *stg = rcp->stages + n;
+		if (!stageread(buf, stg)) {
+			char err[Bufsz];
+			snprintf(err, sizeof(err), "%s", miderrstr());
+			seterrstr("Line %d: %s", lineno, err);
+			return false;
+		}
+		if ((n == 0) != (stg->type == Stagelvl)) {
+			seterrstr("Line %d: the level must be the first stage, and only the first", lineno);
+			return false;
+		}
+		n++;
+	}
+
+	if (n == 0) {
+		seterrstr("Empty recipe");
+		return false;
+	}
+	return true;
+}
+
+/* Reads a stage from a line of the form
+ * 	lvl <w> <h> <d> [nowater] [randstart] [noexit]
+ * or
+ * 	itm|env|enm <num> <name>...
+ * where the names are those in the tables above. */
+static bool stageread(char *line, Stage *stg)
+{
+	static const char *delim = " \t\r\n";
+
+	char *tok = strtok(line, delim);
+	if (strcmp(tok, "lvl") == 0) {
+		stg->type = Stagelvl;
+		int *dims[] = { &stg->w, &stg->h, &stg->d };
+		for (int i = 0; i < 3; i++) {
+			tok = strtok(NULL, delim);
+			if (!tok || (*dims[i] = strtol(tok, NULL, 10)) <= 0) {
+				seterrstr("Expected the level's width, height and depth");
+				return false;
+			}
+		}
+		while ((tok = strtok(NULL, delim))) {
+			if (strcmp(tok, "nowater") == 0)
+				stg->flags |= Lvlnowater;
+			else if (strcmp(tok, "randstart") == 0)
+				stg->flags |= Lvlrandstart;
+			else if (strcmp(tok, "noexit") == 0)
+				stg->flags |= Lvlnoexit;
+			else {
+				seterrstr("Unknown level flag %s", tok);
+				return false;
+			}
+		}
+		return true;
+	}
+
+	const char *const *names;
+	int nnames;
+	if (strcmp(tok, "itm") == 0) {
+		stg->type = Stageitm;
+		names = itmnames;
+		nnames = ItemMax;
+	} else if (strcmp(tok, "env") == 0) {
+		stg->type = Stageenv;
+		names = envnames;
+		nnames = EnvMax;
+	} else if (strcmp(tok, "enm") == 0) {
+		stg->type = Stageenm;
+		names = enmnames;
+		nnames = EnemyMax;
+	} else {
+		seterrstr("Unknown stage %s", tok);
+		return false;
+	}
+
+	tok = strtok(NULL, delim);
+	if (!tok || (stg->num = strtol(tok, NULL, 10)) <= 0) {
+		seterrstr("Expected the number to place");
+		return false;
+	}
+
+	int n = 0;
+	while ((tok = strtok(NULL, delim))) {
+		if (n == Maxstageids) {
+			seterrstr("Too many IDs");
+			return false;
+		}
+		int id = lookup(names, nnames, tok);
+		if (id <= 0) {
+			seterrstr("Unknown name %s", tok);
+			return false;
+		}
+		stg->ids[n++] = id;
+	}
+	if (n == 0) {
+		seterrstr("Expected at least one name");
+		return false;
+	}
+	return true;
+}
+
+static int lookup(const char *const names[], int n, const char *name)
+{
+	for (int i = 1; i < n; i++) {
+		if (names[i] && strcmp(names[i], name) == 0)
+			return i;
+	}
+	return -1;
+}
@@ -3,18 +3,19 @@
 #include <stdbool.h>
 #include "lvlgen.h"
 #include "../../include/mid.h"
+#include "../../include/rng.h"
 
-static bool withprob(double pr);
+static bool withprob(Rng *, double pr);
 
 static const double Prob = 0.33;
 
-void water(Lvl *lvl)
+void water(Rng *r, Lvl *lvl)
 {
 	for (int z = 0; z < lvl->d; z++) {
-		if (!withprob(Prob))
+		if (!withprob(r, Prob))
 			continue;
 
-		unsigned int ht = rnd(1, lvl->h - 2);
+		unsigned int ht = rnd(r, 1, lvl->h - 2);
 
 		for (int x = 0; x < lvl->w - 1; x++) {
 		for (int y = lvl->h - 2; y > lvl->h - 2 - ht; y--) {
@@ -28,7 +29,7 @@ void water(Lvl *lvl)
 
 enum { Mult = 1000 };
 
-static bool withprob(double pr)
+static bool withprob(Rng *r, double pr)
 {
-	return rnd(0, Mult) < pr * Mult;
+	return rnd(r, 0, Mult) < pr * Mult;
 }
@@ -0,0 +1,27 @@
+/* © 2013 the Mid Authors under the MIT license. See AUTHORS for the list of authors.*/
+
+#include "../../include/mid.h"
+#include "../../include/rng.h"
+#include "../../include/gen.h"
+#include <stdbool.h>
+
+Zone *genzone(Rng *r, const Recipe *rcp)
+{
+	const Stage *stg = rcp->stages;
+
+	if (stg->type != Stagelvl) {
+		seterrstr("The first stage of a recipe must generate the level");
+		return NULL;
+	}
+
+	Rng lr, sr;
+	rnginit(&lr, rngint(r));
+	rnginit(&sr, rngint(r));
+
+	Zone *zn = zonenew(lvlgen(&lr, stg->w, stg->h, stg->d, stg->flags));
+	if (!placegen(&sr, zn, rcp)) {
+		zonefree(zn);
+		return NULL;
+	}
+	return zn;
+}
@@ -0,0 +1,188 @@
+/* © 2013 the Mid Authors under the MIT license. See AUTHORS for the list of authors.*/
+
+#include "../../include/mid.h"
+#include <stdbool.h>
+#include <math.h>
+
+static int *indp(Cands *, int z, int x, int y);
+static void rm(Cands *, int i);
+static _Bool farther(Zone *, Cand, Cand);
+static void siftdown(Zone *, Cand [], int n, int i);
+
+Cands *candsnew(Zone *zn, int z0, int z1, Point wh, Candok ok)
+{
+	Lvl *lvl = zn->lvl;
+	if (z0 < 0)
+		z0 = 0;
+	if (z1 > lvl->d)
+		z1 = lvl->d;
+
+	Cands *cs = xalloc(1, sizeof(*cs));
+	cs->zn = zn;
+	cs->z0 = z0;
+	cs->z1 = z1;
+	cs->wh = wh;
+	cs->ok = ok;
+
+	size_t sz = (size_t) (z1 > z0 ? z1 - z0 : 0) * lvl->w * lvl->h;
+	cs->cs = xalloc(sz, sizeof(cs->cs[0]));
+	cs->ind = xalloc(sz, sizeof(cs->ind[0]));
+
+	for (int z = z0; z < z1; z++) {
+	for (int x = 0; x < lvl->w; x++) {
+	for (int y = 0; y < lvl->h; y++) {
+		Point pt = { x, y };
+		if (!ok(zn, z, pt, wh)) {
+			*indp(cs, z, x, y) = -1;
+			continue;
+		}
+		*indp(cs, z, x, y) = cs->n;
+		cs->cs[cs->n++] = (Cand) { pt, z };
+	}
+	}
+	}
+
+	return cs;
+}
+
+void candsfree(Cands *cs)
+{
+	xfree(cs->cs);
+	xfree(cs->ind);
+	xfree(cs);
+}
+
+void candsrm(Cands *cs, int i)
+{
+	rm(cs, i);
+}
+
+void candsrmz(Cands *cs, int z)
+{
+	for (int i = 0; i < cs->n; ) {
+		if (cs->cs[i].z == z)
+			rm(cs, i);
+		else
+			i++;
+	}
+}
+
+_Bool candshas(Cands *cs, Cand c)
+{
+	if (c.z < cs->z0 || c.z >= cs->z1)
+		return false;
+	return *indp(cs, c.z, c.pt.x, c.pt.y) >= 0;
+}
+
+void candsupdate(Cands *cs, int z, Rect r)
+{
+	if (z < cs->z0 || z >= cs->z1)
+		return;
+
+	Lvl *lvl = cs->zn->lvl;
+	Line1d x = rectprojx(r), y = rectprojy(r);
+	int x0 = floor((x.a - cs->wh.x) / Twidth);
+	int x1 = floor(x.b / Twidth);
+	int y0 = floor((y.a - cs->wh.y) / Theight);
+	int y1 = floor(y.b / Theight);
+	if (x0 < 0)
+		x0 = 0;
+	if (y0 < 0)
+		y0 = 0;
+	if (x1 >= lvl->w)
+		x1 = lvl->w - 1;
+	if (y1 >= lvl->h)
+		y1 = lvl->h - 1;
+
+	for (int yy = y0; yy <= y1; yy++) {
+	for (int xx = x0; xx <= x1; xx++) {
+		int i = *indp(cs, z, xx, yy);
+		if (i >= 0 && !cs->ok(cs->zn, z, cs->cs[i].pt, cs->wh))
+			rm(cs, i);
+	}
+	}
+}
+
+int candsnear(Cands *cs, Cand near[], int k)
+{
+	Zone *zn = cs->zn;
+
+	// near is a max-heap of the nearest k candidates so far.
+	int n = 0;
+	for (int i = 0; i < cs->n; i++) {
+		Cand c = cs->cs[i];
+		if (zonedist(zn, c.z, c.pt) < 0)
+			continue;
+		if (n < k) {
+			int j = n++;
+			near[j] = c;
+			for ( ; j > 0 && farther(zn, near[j], near[(j-1)/2]); j = (j-1)/2) {
+				Cand t = near[j];
+				near[j] = near[(j-1)/2];
+				near[(j-1)/2] = t;
+			}
+		} else if (k > 0 && farther(zn, near[0], c)) {
+			near[0] = c;
+			siftdown(zn, near, n, 0);
+		}
+	}
+
+	for (int m = n - 1; m > 0; m--) {
+		Cand t = near[0];
+		near[0] = near[m];
+		near[m] = t;
+		siftdown(zn, near, m, 0);
+	}
+	return n;
+}
+
+static int *indp(Cands *cs, int z, int x, int y)
+{
+	Lvl *lvl = cs->zn->lvl;
+	return &cs->ind[((size_t) (z - cs->z0) * lvl->w + x) * lvl->h + y];
+}
+
+// Removes candidate i, moving the last candidate into its place.
+static void rm(Cands *cs, int i)
+{
+	Cand c = cs->cs[i];
+	*indp(cs, c.z, c.pt.x, c.pt.y) = -1;
+
+	cs->n--;
+	if (i == cs->n)
+		return;
+	cs->cs[i] = cs->cs[cs->n];
+	c = cs->cs[i];
+	*indp(cs, c.z, c.pt.x, c.pt.y) = i;
+}
+
+// Is a farther than b?  Ties are broken by location so that
+// the order doesn't depend on the order of the candidates.
+static _Bool farther(Zone *zn, Cand a, Cand b)
+{
+	int da = zonedist(zn, a.z, a.pt), db = zonedist(zn, b.z, b.pt);
+	if (da != db)
+		return da > db;
+	if (a.z != b.z)
+		return a.z > b.z;
+	if (a.pt.x != b.pt.x)
+		return a.pt.x > b.pt.x;
+	return a.pt.y > b.pt.y;
+}
+
+static void siftdown(Zone *zn, Cand h[], int n, int i)
+{
+	for ( ; ; ) {
+		int m = i, l = 2*i + 1, r = 2*i + 2;
+		if (l < n && farther(zn, h[l], h[m]))
+			m = l;
+		if (r < n && farther(zn, h[r], h[m]))
+			m = r;
+		if (m == i)
+			return;
+		Cand t = h[i];
+		h[i] = h[m];
+		h[m] = t;
+		i = m;
+	}
+}
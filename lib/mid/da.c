@@ -22,6 +22,7 @@ Info dainfo = {
 _Bool dainit(Enemy *e, int x, int y){
 	e->hp = 12;
 	e->data = 0;
+	aipatroller(&e->ai, 3);
 	return 1;
 }
 
@@ -58,12 +58,16 @@ struct Enemymt{
 	void (*draw)(Enemy*, Gfx*);
 	_Bool (*scan)(char *, Enemy *);
 	_Bool (*print)(char *, size_t, Enemy *);
+
+	/* Optional, for enemies with state beyond the Enemy fields. */
+	void (*getaux)(Enemy *, int aux[Enemyaux]);
+	void (*setaux)(Enemy *, const int aux[Enemyaux]);
 };
 
 #define ENEMYMT(e) e##init, e##free, e##update, e##draw, e##scan, e##print
 
 static Enemymt mt[] = {
-	[EnemyUnti] = { ENEMYMT(unti) },
+	[EnemyUnti] = { ENEMYMT(unti), untigetaux, untisetaux },
 	[EnemyNous] = { ENEMYMT(nous) },
 	[EnemyDa] = { ENEMYMT(da) },
 	[EnemyThu] = { ENEMYMT(thu) },
@@ -120,6 +124,28 @@ _Bool enemyprint(char *buf, size_t s, Enemy *e){
 	return mt[e->id].print(buf, s, e);
 }
 
+void enemyaux(Enemy *e, int aux[Enemyaux]){
+	for(int i = 0; i < Enemyaux; i++)
+		aux[i] = 0;
+	if(mt[e->id].getaux)
+		mt[e->id].getaux(e, aux);
+}
+
+_Bool enemyload(Enemy *e, EnemyID id, Body body, int hp, const int aux[Enemyaux]){
+	*e = (Enemy){};
+	if(id <= 0 || id >= EnemyMax)
+		return 0;
+
+	e->id = id;
+	if(!mt[id].init(e, 0, 0))
+		return 0;
+	e->body = body;
+	e->hp = hp;
+	if(mt[id].setaux)
+		mt[id].setaux(e, aux);
+	return 1;
+}
+
 _Bool defaultscan(char *buf, Enemy *e){
 	return scangeom(buf, "dyd", &e->id, &e->body, &e->hp);
 }
@@ -39,6 +39,8 @@ extern Info e##info
 extern Sfx *untihit;
 extern Img *untiimg;
 ENEMYDECL(unti);
+void untigetaux(Enemy*,int[Enemyaux]);
+void untisetaux(Enemy*,const int[Enemyaux]);
 
 extern Img *nousimg;
 ENEMYDECL(nous);
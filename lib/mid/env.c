@@ -28,6 +28,11 @@ static void stonegenact(Env *e, Player *p, Zone *z, int stat, ItemID *drops, int
 
 static Rng rng;
 
+/* Envs are initialized by the zone generators, possibly on a
+ * worker thread while the game is running, so they must not
+ * share the gameplay Rng, nor one Rng between threads. */
+static __thread Rng initrng;
+
 static EnvOps ops[] = {
 	[EnvShrempty] = {
 		"img/shrine.png",
@@ -105,7 +110,7 @@ _Bool envinit(Env *e, EnvID id, Point p){
 	e->body.bbox.b.x = e->body.bbox.a.x + ops[id].wh.x;
 	e->body.bbox.b.y = e->body.bbox.a.y + ops[id].wh.y;
 
-	e->min = rngintincl(&rng, 5, 30);
+	e->min = rngintincl(&initrng, 5, 30);
 
 	return 1;
 }
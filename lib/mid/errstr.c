@@ -8,7 +8,9 @@
 
 enum { Bufsz = 1024 };
 
-static char curerr[Bufsz];
+/* Each thread has its own error, so that one thread's error is
+ * never reported by, or lost to, another. */
+static __thread char curerr[Bufsz];
 
 void seterrstr(const char *fmt, ...)
 {
@@ -22,7 +24,7 @@ const char *miderrstr(void){
 	int err = errno;
 
 	if (curerr[0] != '\0') {
-		static char retbuf[Bufsz];
+		static __thread char retbuf[Bufsz];
 		strncpy(retbuf, curerr, Bufsz - 1);
 		retbuf[Bufsz - 1] = '\0';
 		curerr[0] = '\0';
@@ -31,6 +31,7 @@ _Bool grenduinit(Enemy *e, int x, int y){
 	a->f = 0;
 	a->d = a->delay;
 	e->data = a;
+	aihunter(&e->ai, 8, 2, 32*3);
 	return 1;
 }
 
@@ -68,8 +69,6 @@ _Bool grenduscan(char *buf, Enemy *e){
 	if (!defaultscan(buf, e))
 		return 0;
 
-	aihunter(&e->ai, 8, 2, 32*3);
-
 	return 1;
 }
 
@@ -6,11 +6,27 @@
 #include <stdbool.h>
 #include <errno.h>
 #include <math.h>
+#include <stdint.h>
+#include <string.h>
 
 enum { Blkvis = 1 << 1 };
 static const double Grav = 0.5;
 
+/* The most bytes of a LEB128 varint of 64 bits. */
+enum { Maxvarint = 10 };
+
+/* The largest depth, width and height, and the most blocks, of
+ * a level read from a file. */
+enum { Maxlvldim = 1 << 12, Maxlvlblks = 1 << 24 };
+
 static bool tileread(FILE *f, Lvl *l, int x, int y, int z);
+static bool tileok(Lvl *l, int c, int x, int y, int z);
+static bool hdrok(int32_t hdr[4]);
+static bool blksok(Lvl *l);
+static bool packedok(int32_t[4], uint64_t);
+static Lvl *packedread(int32_t[4], const unsigned char *, uint64_t);
+static const unsigned char *runsread(const unsigned char *, const unsigned char *, char *, size_t);
+static unsigned char *runswrite(unsigned char *, const char *, size_t);
 static void tiledraw(Gfx *g, int t, Point pt, int l);
 static void tiledrawlyrs(Gfx *g, int t, Point pt, int mn, int mx);
 static bool isshaded(Lvl *l, int t, int x, int y);
@@ -134,12 +150,16 @@ static bool istile(int t)
 
 void lvlfree(Lvl *l)
 {
+	if (l->unmap)
+		l->unmap(l->map, l->mapsz);
 	xfree(l);
 }
 
 Lvl *lvlnew(int d, int w, int h, int z)
 {
-	Lvl *l = xalloc(1, sizeof(*l) + sizeof(Blk[d * w * h]));
+	// The blocks follow the Lvl in the same allocation.
+	Lvl *l = xalloc(1, sizeof(*l) + sizeof(Blk) * ((size_t) d * w * h));
+	l->blks = (Blk *) (l + 1);
 	l->d = d;
 	l->w = w;
 	l->h = h;
@@ -181,9 +201,12 @@ Lvl *lvlread(FILE *f)
 {
 	int w, h, d, seenz;
 	if (fscanf(f, " %d %d %d %d",&d, &w, &h, &seenz) != 4) {
-		seterrstr("Invalid lvl header: w = %d, h = %d, d = %d, seenz = %d, feof = %d, ferror = %d", feof(f), ferror(f));
+		seterrstr("Invalid lvl header: feof = %d, ferror = %d", feof(f), ferror(f));
 		return NULL;
 	}
+	int32_t hdr[4] = { d, w, h, seenz };
+	if (!hdrok(hdr))
+		return NULL;
 	Lvl *l = lvlnew(d, w, h, seenz);
 
 	int x, y, z;
@@ -207,7 +230,7 @@ Lvl *lvlread(FILE *f)
 errnl:
 	seterrstr("Expected newline in level file: z=%d, x=%d, y=%d", z, x, y);
 err:
-	xfree(l);
+	lvlfree(l);
 	return NULL;
 }
 
@@ -225,6 +248,266 @@ void lvlwrite(FILE *f, Lvl *l)
 	}
 }
 
+/* The binary level is a header of four int32_ts, d, w, h and
+ * seenz, followed by the blocks, tile and flags, in the order of
+ * the blocks in memory, all in the host's byte order.  Since the
+ * blocks are stored just as they are in memory, lvlreadmem can
+ * use them in place. */
+Lvl *lvlreadb(FILE *f)
+{
+	int32_t hdr[4];
+	if (fread(hdr, sizeof(hdr), 1, f) != 1) {
+		seterrstr("Failed to read the level header");
+		return NULL;
+	}
+	if (!hdrok(hdr))
+		return NULL;
+
+	Lvl *l = lvlnew(hdr[0], hdr[1], hdr[2], hdr[3]);
+	size_t n = (size_t) l->d * l->w * l->h;
+	if (fread(l->blks, sizeof(Blk), n, f) != n) {
+		seterrstr("Unexpected EOF in the level's blocks");
+		goto err;
+	}
+	if (!blksok(l))
+		goto err;
+	return l;
+err:
+	lvlfree(l);
+	return NULL;
+}
+
+Lvl *lvlreadmem(void *p, unsigned long sz, unsigned long *n)
+{
+	int32_t hdr[4];
+	if (sz < sizeof(hdr)) {
+		seterrstr("Failed to read the level header");
+		return NULL;
+	}
+	memcpy(hdr, p, sizeof(hdr));
+	if (!hdrok(hdr))
+		return NULL;
+
+	size_t nblks = (sz - sizeof(hdr)) / sizeof(Blk);
+	if ((size_t) hdr[1] * hdr[2] > nblks / hdr[0]) {
+		seterrstr("Unexpected EOF in the level's blocks");
+		return NULL;
+	}
+
+	Lvl *l = xalloc(1, sizeof(*l));
+	l->d = hdr[0];
+	l->w = hdr[1];
+	l->h = hdr[2];
+	l->seenz = hdr[3];
+	l->blks = (Blk *) ((char *) p + sizeof(hdr));
+	if (!blksok(l)) {
+		xfree(l);
+		return NULL;
+	}
+	*n = sizeof(hdr) + sizeof(Blk) * ((size_t) l->d * l->w * l->h);
+	return l;
+}
+
+void lvlwriteb(FILE *f, Lvl *l)
+{
+	int32_t hdr[4] = { l->d, l->w, l->h, l->seenz };
+	fwrite(hdr, sizeof(hdr), 1, f);
+	fwrite(l->blks, sizeof(Blk), (size_t) l->d * l->w * l->h, f);
+}
+
+/* In a packed level the header is followed by the length, as a
+ * uint64_t, of the runs that follow it: those of the tiles and
+ * then those of the flags, each run being a count, as an unsigned
+ * LEB128 varint, and the byte that is repeated.  The walls and
+ * the open space come in long runs, and the flags are mostly zero
+ * with runs of seen blocks along each row, so both pack to a
+ * small part of the blocks. */
+Lvl *lvlreadp(FILE *f)
+{
+	int32_t hdr[4];
+	uint64_t sz;
+	if (fread(hdr, sizeof(hdr), 1, f) != 1 || fread(&sz, sizeof(sz), 1, f) != 1) {
+		seterrstr("Failed to read the level header");
+		return NULL;
+	}
+	if (!hdrok(hdr))
+		return NULL;
+	if (!packedok(hdr, sz))
+		return NULL;
+
+	unsigned char *buf = xalloc(sz + 1, 1);
+	if (fread(buf, 1, sz, f) != sz) {
+		seterrstr("Unexpected EOF in the level's runs");
+		xfree(buf);
+		return NULL;
+	}
+	Lvl *l = packedread(hdr, buf, sz);
+	xfree(buf);
+	return l;
+}
+
+Lvl *lvlreadpmem(const void *p, unsigned long sz, unsigned long *n)
+{
+	int32_t hdr[4];
+	uint64_t len;
+	if (sz < sizeof(hdr) + sizeof(len)) {
+		seterrstr("Failed to read the level header");
+		return NULL;
+	}
+	memcpy(hdr, p, sizeof(hdr));
+	memcpy(&len, (const char *) p + sizeof(hdr), sizeof(len));
+	if (!hdrok(hdr))
+		return NULL;
+	if (!packedok(hdr, len))
+		return NULL;
+	if (len > sz - sizeof(hdr) - sizeof(len)) {
+		seterrstr("Unexpected EOF in the level's runs");
+		return NULL;
+	}
+
+	Lvl *l = packedread(hdr, (const unsigned char *) p + sizeof(hdr) + sizeof(len), len);
+	if (l)
+		*n = sizeof(hdr) + sizeof(len) + len;
+	return l;
+}
+
+// Each of the two sets of runs takes at most two bytes a block.
+static bool packedok(int32_t hdr[4], uint64_t sz)
+{
+	size_t n = (size_t) hdr[0] * hdr[1] * hdr[2];
+	if (sz > 4 * n + 2 * Maxvarint) {
+		seterrstr("Invalid packed level size %llu", (unsigned long long) sz);
+		return false;
+	}
+	return true;
+}
+
+// Decodes the sz bytes of runs at p into a new level.
+static Lvl *packedread(int32_t hdr[4], const unsigned char *p, uint64_t sz)
+{
+	Lvl *l = lvlnew(hdr[0], hdr[1], hdr[2], hdr[3]);
+	size_t n = (size_t) l->d * l->w * l->h;
+	const unsigned char *end = p + sz;
+	if (!(p = runsread(p, end, &l->blks[0].tile, n)) || !(p = runsread(p, end, &l->blks[0].flags, n))) {
+		lvlfree(l);
+		return NULL;
+	}
+	if (!blksok(l)) {
+		lvlfree(l);
+		return NULL;
+	}
+	return l;
+}
+
+void lvlwritep(FILE *f, Lvl *l)
+{
+	int32_t hdr[4] = { l->d, l->w, l->h, l->seenz };
+	fwrite(hdr, sizeof(hdr), 1, f);
+
+	size_t n = (size_t) l->d * l->w * l->h;
+	unsigned char *buf = xalloc(4 * n + 2 * Maxvarint, 1);
+	unsigned char *p = runswrite(buf, &l->blks[0].tile, n);
+	p = runswrite(p, &l->blks[0].flags, n);
+
+	uint64_t sz = p - buf;
+	fwrite(&sz, sizeof(sz), 1, f);
+	fwrite(buf, 1, sz, f);
+	xfree(buf);
+}
+
+// Decodes the runs of n bytes, one byte per block, from p into
+// the blocks at b, returning the end of the runs or NULL.
+static const unsigned char *runsread(const unsigned char *p, const unsigned char *end, char *b, size_t n)
+{
+	for (size_t i = 0; i < n; ) {
+		if (end - p < 2) {
+			seterrstr("Unexpected EOF in the level's runs");
+			return NULL;
+		}
+		uint64_t k = *p++;
+		if (k & 0x80) {
+			// Runs of 128 blocks or more are rare.
+			k &= 0x7F;
+			int sh = 7;
+			do {
+				if (p == end || sh > 63) {
+					seterrstr("Unexpected EOF in the level's runs");
+					return NULL;
+				}
+				k |= (uint64_t) (*p & 0x7F) << sh;
+				sh += 7;
+			} while (*p++ & 0x80);
+			if (p == end) {
+				seterrstr("Unexpected EOF in the level's runs");
+				return NULL;
+			}
+		}
+		if (k == 0 || k > n - i) {
+			seterrstr("Bad run of %llu blocks at block %zu", (unsigned long long) k, i);
+			return NULL;
+		}
+		char c = *p++;
+		for (size_t e = i + k; i < e; i++)
+			b[i * sizeof(Blk)] = c;
+	}
+	return p;
+}
+
+// Encodes the runs of the n bytes, one byte per block, of the
+// blocks at b to p, returning the end of the runs.
+static unsigned char *runswrite(unsigned char *p, const char *b, size_t n)
+{
+	for (size_t i = 0; i < n; ) {
+		char c = b[i * sizeof(Blk)];
+		size_t j = i + 1;
+		while (j < n && b[j * sizeof(Blk)] == c)
+			j++;
+
+		uint64_t k = j - i;
+		for ( ; k >= 0x80; k >>= 7)
+			*p++ = (k & 0x7F) | 0x80;
+		*p++ = k;
+		*p++ = c;
+		i = j;
+	}
+	return p;
+}
+
+static bool hdrok(int32_t hdr[4])
+{
+	int d = hdr[0], w = hdr[1], h = hdr[2];
+	if (d <= 0 || w <= 0 || h <= 0 || d > Maxlvldim || w > Maxlvldim || h > Maxlvldim) {
+		seterrstr("Invalid lvl header: d = %d, w = %d, h = %d", d, w, h);
+		return false;
+	}
+	// The blocks follow the Lvl in lvlnew's allocation, and
+	// lvlreadp and lvlwritep buffer up to four bytes a block.
+	size_t max = (SIZE_MAX - sizeof(Lvl) - 2 * Maxvarint) / (4 * sizeof(Blk));
+	if (max > Maxlvlblks)
+		max = Maxlvlblks;
+	if ((size_t) w * h > max / d) {
+		seterrstr("Lvl too big: d = %d, w = %d, h = %d", d, w, h);
+		return false;
+	}
+	return true;
+}
+
+// Checks the tiles of blocks read in binary.  Only the tiles
+// that aren't plainly fine get the full check from tileok.
+static bool blksok(Lvl *l)
+{
+	size_t i = 0;
+	for (int z = 0; z < l->d; z++) {
+		unsigned int bad = (z == 0 ? Tfdoor : 0) | (z == l->d - 1 ? Tbdoor : 0);
+		for (int j = 0; j < l->w * l->h; j++, i++) {
+			int c = (unsigned char) l->blks[i].tile;
+			if ((!istile(c) || tiles[c].flags & bad) && !tileok(l, c, j % l->w, j / l->w, z))
+				return false;
+		}
+	}
+	return true;
+}
+
 static bool tileread(FILE *f, Lvl *l, int x, int y, int z)
 {
 	int c = fgetc(f);
@@ -232,7 +515,16 @@ static bool tileread(FILE *f, Lvl *l, int x, int y, int z)
 		seterrstr("Unexpected EOF");
 		return false;
 	}
+	if (!tileok(l, c, x, y, z))
+		return false;
 
+	blk(l, x, y, z)->tile = c;
+
+	return true;
+}
+
+static bool tileok(Lvl *l, int c, int x, int y, int z)
+{
 	if (!istile(c)) {
 		seterrstr("Invalid tile: %c at x=%d, y=%d, z=%d\n", c, x, y, z);
 		return false;
@@ -246,9 +538,6 @@ static bool tileread(FILE *f, Lvl *l, int x, int y, int z)
 		seterrstr("Back door on x=%d, y=%d, z=max", x, y);
 		return false;
 	}
-
-	blk(l, x, y, z)->tile = c;
-
 	return true;
 }
 
@@ -36,6 +36,7 @@ _Bool nousinit(Enemy *e, int x, int y){
 	a->f = 0;
 	a->d = a->delay;
 	e->data = a;
+	aiwalker(&e->ai, 2);
 	return 1;
 }
 
@@ -65,8 +66,6 @@ _Bool nousscan(char *buf, Enemy *e){
 	if (!defaultscan(buf, e))
 		return 0;
 
-	aiwalker(&e->ai, 2);
-
 	return 1;
 }
 
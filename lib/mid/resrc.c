@@ -148,6 +148,24 @@ static Resrc *resrcnew(const char *path, const char *file, void *aux)
 	return r;
 }
 
+_Bool resrcpath(const char *file, char path[], int sz)
+{
+	char p[PATH_MAX + 1];
+	for (int i = 0; i < NROOTS; i += 1) {
+		fscat(roots[i], file, p);
+		if (!fsexists(p))
+			continue;
+		if (strlen(p) >= sz) {
+			seterrstr("Path is too long: %s", p);
+			return false;
+		}
+		strcpy(path, p);
+		return true;
+	}
+	seterrstr("%s: Not found", file);
+	return false;
+}
+
 static Resrc *resrcload(Rtab *t, const char *file, void *aux)
 {
 	char path[PATH_MAX + 1];
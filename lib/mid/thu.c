@@ -31,6 +31,7 @@ _Bool thuinit(Enemy *e, int x, int y){
 	a->f = 0;
 	a->d = a->delay;
 	e->data = a;
+	aichaser(&e->ai, 4, 32*3);
 	return 1;
 }
 
@@ -66,8 +67,6 @@ _Bool thuscan(char *buf, Enemy *e){
 	if (!defaultscan(buf, e))
 		return 0;
 
-	aichaser(&e->ai, 4, 32*3);
-
 	return 1;
 }
 
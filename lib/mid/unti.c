@@ -35,6 +35,7 @@ _Bool untiinit(Enemy *e, int x, int y){
 	u->c = (Color){ 255, 55, 55, 255 };
 
 	e->data = u;
+	aijumper(&e->ai, 8);
 	return 1;
 }
 
@@ -73,3 +74,16 @@ _Bool untiprint(char *buf, size_t sz, Enemy *e){
 	Color c = u->c;
 	return printgeom(buf, sz, "dyddddd", e->id, e->body, e->hp, c.r, c.g, c.b, c.a);
 }
+
+void untigetaux(Enemy *e, int aux[Enemyaux]){
+	Unti *u = e->data;
+	aux[0] = u->c.r;
+	aux[1] = u->c.g;
+	aux[2] = u->c.b;
+	aux[3] = u->c.a;
+}
+
+void untisetaux(Enemy *e, const int aux[Enemyaux]){
+	Unti *u = e->data;
+	u->c = (Color){ aux[0], aux[1], aux[2], aux[3] };
+}
@@ -6,6 +6,8 @@
 #include <limits.h>
 #include <string.h>
 #include <stdbool.h>
+#include <math.h>
+#include <stdint.h>
 #include "../../include/mid.h"
 
 _Bool itemscan(char *, Item *);
@@ -15,6 +17,90 @@ _Bool envprint(char *, size_t, Env *);
 _Bool enemyscan(char *, Enemy *);
 _Bool enemyprint(char *, size_t, Enemy *);
 
+/* The magic number and version that begin a binary zone.  A
+ * packed zone, whose level is run-length encoded, and a streamed
+ * zone, whose records are tagged, have their own magic numbers,
+ * but all three begin with the same byte. */
+static const char Zbmagic[4] = "MIDZ";
+static const char Zpmagic[4] = "MIDP";
+static const char Zsmagic[4] = "MIDS";
+enum { Zbversion = 2 };
+enum { Zbplain, Zbpacked, Zbstream };
+
+/* The tags of the records of a streamed zone. */
+enum { Tagend, Tagitem, Tagenv, Tagenemy };
+
+/* Fixed-size records of the binary zone format. */
+typedef struct Bodyrec Bodyrec;
+struct Bodyrec {
+	double bbox[4], vel[2], acc[2];
+	int32_t fall, pad;
+};
+
+typedef struct Itemrec Itemrec;
+struct Itemrec {
+	int32_t z, id;
+	Bodyrec body;
+};
+
+typedef struct Envrec Envrec;
+struct Envrec {
+	int32_t z, id, gotit, min;
+	Bodyrec body;
+};
+
+typedef struct Enemyrec Enemyrec;
+struct Enemyrec {
+	int32_t z, id, hp, pad;
+	int32_t aux[Enemyaux];
+	Bodyrec body;
+};
+
+/* The things touching each block of a zone: head has, for each
+ * block, one more than the index in refs of the first Occref of
+ * the block, or zero if there are none, and each Occref links to
+ * the next in the same way.  Unused Occrefs are linked from free.
+ * An Occref names a thing by its kind and its index in the
+ * layer's array of things of that kind. */
+typedef struct Occref Occref;
+struct Occref {
+	int next;
+	unsigned char kind, i;
+};
+
+enum { Occitem, Occenv, Occenemy };
+
+typedef struct Occ Occ;
+struct Occ {
+	int *head;
+	Occref *refs;
+	int n, sz, free;
+};
+
+/* Where a binary zone is read from: the file f or, if f is
+ * NULL, the bytes from p up to end. */
+typedef struct Src Src;
+struct Src {
+	FILE *f;
+	char *p, *end;
+};
+
+static Zone *zonereadb(FILE *);
+static Zone *bodyread(FILE *, int, FILE *);
+static _Bool srcread(Src *, void *, size_t);
+static _Bool hdrread(Src *, int *);
+static _Bool recsread(Src *, Zone *);
+static _Bool tagsread(Src *, Zone *, FILE *);
+static void recswrite(FILE *, Zone *);
+static void tagswrite(FILE *, Zone *, unsigned char *);
+static _Bool itemadd(Zone *, Itemrec *, uint32_t);
+static _Bool envadd(Zone *, Envrec *, uint32_t);
+static _Bool enemyadd(Zone *, Enemyrec *, uint32_t);
+static Itemrec itemrec(int, Item *);
+static Envrec envrec(int, Env *);
+static Enemyrec enemyrec(int, Enemy *);
+static Bodyrec bodyrec(Body);
+static Body recbody(Bodyrec);
 static _Bool readitem(char *buf, Zone *zn);
 static _Bool readenv(char *buf, Zone *zn);
 static _Bool readenemy(char *buf, Zone *zn);
@@ -22,50 +108,118 @@ static _Bool readl(char *buf, int sz, FILE *f);
 static _Bool readblkflgs(char *, Lvl *);
 static _Bool blkflgszero(Lvl *lvl, int y, int z);
 static void writeblkflgs(FILE *, Lvl *);
+static Occ *occnew(Lvl *);
+static Occ *occcopy(Occ *, Lvl *);
+static void occfree(Occ *);
+static void occmark(Zone *, int, Rect, int, int);
+static int *occnext(Zone *, int, int, int, int *, Rect *);
+static _Bool occbbox(Zone *, int, Occref *, Rect *);
+static _Bool occrange(Lvl *, Rect, int *, int *, int *, int *);
+static void distfill(Zone *);
 
 enum { Bufsz = 256 };
 
+Zone *zonenew(Lvl *lvl)
+{
+	Zone *zn = xalloc(1, sizeof(*zn));
+	zn->lvl = lvl;
+	zn->itms = xalloc(lvl->d, sizeof(zn->itms[0]));
+	zn->envs = xalloc(lvl->d, sizeof(zn->envs[0]));
+	zn->enms = xalloc(lvl->d, sizeof(zn->enms[0]));
+	zn->mags = xalloc(lvl->d, sizeof(zn->mags[0]));
+	zn->occ = occnew(lvl);
+	return zn;
+}
+
+Zone *zonecopy(Zone *zn)
+{
+	Lvl *l = zn->lvl;
+	Lvl *lvl = lvlnew(l->d, l->w, l->h, l->seenz);
+	lvl->z = l->z;
+	memcpy(lvl->blks, l->blks, sizeof(Blk) * ((size_t) l->d * l->w * l->h));
+
+	Zone *c = zonenew(lvl);
+	memcpy(c->itms, zn->itms, l->d * sizeof(zn->itms[0]));
+	memcpy(c->envs, zn->envs, l->d * sizeof(zn->envs[0]));
+	memcpy(c->mags, zn->mags, l->d * sizeof(zn->mags[0]));
+	occfree(c->occ);
+	c->occ = occcopy(zn->occ, l);
+
+	// An enemy's data is its own, so each is loaded afresh from
+	// what would be saved of it, as when the zone is read.
+	for (int z = 0; z < l->d; z++) {
+		for (int i = 0; i < Maxenms; i++) {
+			Enemy *e = &zn->enms[z][i];
+			if (!e->id)
+				continue;
+			int aux[Enemyaux];
+			enemyaux(e, aux);
+			if (!enemyload(&c->enms[z][i], e->id, e->body, e->hp, aux)) {
+				seterrstr("Failed to copy enemy %d with ID %d", i, e->id);
+				zonefree(c);
+				return NULL;
+			}
+		}
+	}
+	c->dirty = zn->dirty;
+	return c;
+}
+
 Zone *zoneread(FILE *f)
 {
-	char buf[Bufsz];
 	int itms = 0, envs = 0, enms = 0;
 
-	Zone *zn = xalloc(1, sizeof(*zn));
-	zn->lvl = lvlread(f);
-	if (!zn->lvl) {
+	int c = getc(f);
+	if (c == EOF) {
+		seterrstr("Failed to read the level: Unexpected EOF");
+		return NULL;
+	}
+	ungetc(c, f);
+	if (c == Zbmagic[0])
+		return zonereadb(f);
+
+	Lvl *lvl = lvlread(f);
+	if (!lvl) {
 		seterrstr("Failed to read the level: %s", miderrstr());
 		return false;
 	}
+	Zone *zn = zonenew(lvl);
+
+	// A flag row has up to four digits and a space for each block.
+	int sz = Bufsz + 5 * lvl->w;
+	char *buf = xalloc(sz, 1);
+	bool ok = true;
 
-	while (readl(buf, Bufsz, f)) {
+	while (ok && readl(buf, sz, f)) {
 		if (buf[0] == '\0')
 			continue;
 		switch (buf[0]) {
 		case 'i':
-			if (!readitem(buf+1, zn))
-				return NULL;
+			ok = readitem(buf+1, zn);
 			itms++;
 			break;
 		case 'e':
-			if (!readenv(buf+1, zn))
-				return NULL;
+			ok = readenv(buf+1, zn);
 			envs++;
 			break;
 		case 'n':
-			if (!readenemy(buf+1, zn))
-				return NULL;
+			ok = readenemy(buf+1, zn);
 			enms++;
 			break;
 		case 'f':
-			if (!readblkflgs(buf+1, zn->lvl))
-				return NULL;
+			ok = readblkflgs(buf+1, zn->lvl);
 			break;
 		default:
 			seterrstr("Unexpected input line: [%s]", buf);
-			return NULL;
+			ok = false;
 		}
 	}
 
+	xfree(buf);
+	if (!ok) {
+		zonefree(zn);
+		return NULL;
+	}
 	return zn;
 }
 
@@ -151,7 +305,7 @@ void zonewrite(FILE *f, Zone *zn)
 	lvlwrite(f, zn->lvl);
 	writeblkflgs(f, zn->lvl);
 
-	for (int z = 0; z < Maxz; z++) {
+	for (int z = 0; z < zn->lvl->d; z++) {
 		Item *itms = zn->itms[z];
 		for (int i = 0; i < Maxitms; i++) {
 			if (!itms[i].id)
@@ -179,8 +333,488 @@ void zonewrite(FILE *f, Zone *zn)
 	}
 }
 
+void zonewriteb(FILE *f, Zone *zn)
+{
+	uint32_t v = Zbversion;
+	fwrite(Zbmagic, sizeof(Zbmagic), 1, f);
+	fwrite(&v, sizeof(v), 1, f);
+	lvlwriteb(f, zn->lvl);
+	recswrite(f, zn);
+}
+
+void zonewritep(FILE *f, Zone *zn)
+{
+	uint32_t v = Zbversion;
+	fwrite(Zpmagic, sizeof(Zpmagic), 1, f);
+	fwrite(&v, sizeof(v), 1, f);
+	lvlwritep(f, zn->lvl);
+	recswrite(f, zn);
+}
+
+void zonewrites(FILE *f, Zone *zn)
+{
+	uint32_t v = Zbversion;
+	fwrite(Zsmagic, sizeof(Zsmagic), 1, f);
+	fwrite(&v, sizeof(v), 1, f);
+	lvlwriteb(f, zn->lvl);
+	tagswrite(f, zn, NULL);
+}
+
+Zstrm *zstrmread(FILE *in, FILE *out)
+{
+	Zstrm *s = xalloc(1, sizeof(*s));
+
+	int c = getc(in);
+	ungetc(c, in);
+	if (c != Zbmagic[0]) {
+		s->zn = zoneread(in);
+	} else {
+		Src src = { .f = in };
+		int kind;
+		if (hdrread(&src, &kind)) {
+			if (kind == Zbstream)
+				s->out = out;
+			s->zn = bodyread(in, kind, s->out);
+		}
+	}
+	if (!s->zn) {
+		xfree(s);
+		return NULL;
+	}
+	if (!s->out)
+		return s;
+
+	// Remember what was already in the zone, since only what the
+	// stage adds is appended to the stream.
+	Zone *zn = s->zn;
+	s->had = xalloc(zn->lvl->d, Maxitms + Maxenvs + Maxenms);
+	for (int z = 0; z < zn->lvl->d; z++) {
+		unsigned char *h = s->had + z * (Maxitms + Maxenvs + Maxenms);
+		for (int i = 0; i < Maxitms; i++)
+			h[i] = zn->itms[z][i].id != 0;
+		for (int i = 0; i < Maxenvs; i++)
+			h[Maxitms + i] = zn->envs[z][i].id != 0;
+		for (int i = 0; i < Maxenms; i++)
+			h[Maxitms + Maxenvs + i] = zn->enms[z][i].id != 0;
+	}
+	return s;
+}
+
+void zstrmwrite(Zstrm *s, FILE *f, void (*write)(FILE *, Zone *))
+{
+	if (!s->out) {
+		write(f, s->zn);
+		return;
+	}
+	tagswrite(s->out, s->zn, s->had);
+	fflush(s->out);
+}
+
+void zstrmfree(Zstrm *s)
+{
+	zonefree(s->zn);
+	xfree(s->had);
+	xfree(s);
+}
+
+// Writes the item, env and enemy records that follow the level.
+static void recswrite(FILE *f, Zone *zn)
+{
+	uint32_t n[3] = {};
+	for (int z = 0; z < zn->lvl->d; z++) {
+		for (int i = 0; i < Maxitms; i++)
+			n[0] += zn->itms[z][i].id != 0;
+		for (int i = 0; i < Maxenvs; i++)
+			n[1] += zn->envs[z][i].id != 0;
+		for (int i = 0; i < Maxenms; i++)
+			n[2] += zn->enms[z][i].id != 0;
+	}
+	fwrite(n, sizeof(n), 1, f);
+
+	for (int z = 0; z < zn->lvl->d; z++) {
+		for (int i = 0; i < Maxitms; i++) {
+			if (!zn->itms[z][i].id)
+				continue;
+			Itemrec r = itemrec(z, &zn->itms[z][i]);
+			fwrite(&r, sizeof(r), 1, f);
+		}
+	}
+	for (int z = 0; z < zn->lvl->d; z++) {
+		for (int i = 0; i < Maxenvs; i++) {
+			if (!zn->envs[z][i].id)
+				continue;
+			Envrec r = envrec(z, &zn->envs[z][i]);
+			fwrite(&r, sizeof(r), 1, f);
+		}
+	}
+	for (int z = 0; z < zn->lvl->d; z++) {
+		for (int i = 0; i < Maxenms; i++) {
+			if (!zn->enms[z][i].id)
+				continue;
+			Enemyrec r = enemyrec(z, &zn->enms[z][i]);
+			fwrite(&r, sizeof(r), 1, f);
+		}
+	}
+}
+
+// Writes a tagged record for everything in the zone that isn't
+// marked in had, if had isn't NULL, and then the end tag.
+static void tagswrite(FILE *f, Zone *zn, unsigned char *had)
+{
+	for (int z = 0; z < zn->lvl->d; z++) {
+		unsigned char *h = had ? had + z * (Maxitms + Maxenvs + Maxenms) : NULL;
+		for (int i = 0; i < Maxitms; i++) {
+			if (!zn->itms[z][i].id || (h && h[i]))
+				continue;
+			int32_t tag = Tagitem;
+			Itemrec r = itemrec(z, &zn->itms[z][i]);
+			fwrite(&tag, sizeof(tag), 1, f);
+			fwrite(&r, sizeof(r), 1, f);
+		}
+		for (int i = 0; i < Maxenvs; i++) {
+			if (!zn->envs[z][i].id || (h && h[Maxitms + i]))
+				continue;
+			int32_t tag = Tagenv;
+			Envrec r = envrec(z, &zn->envs[z][i]);
+			fwrite(&tag, sizeof(tag), 1, f);
+			fwrite(&r, sizeof(r), 1, f);
+		}
+		for (int i = 0; i < Maxenms; i++) {
+			if (!zn->enms[z][i].id || (h && h[Maxitms + Maxenvs + i]))
+				continue;
+			int32_t tag = Tagenemy;
+			Enemyrec r = enemyrec(z, &zn->enms[z][i]);
+			fwrite(&tag, sizeof(tag), 1, f);
+			fwrite(&r, sizeof(r), 1, f);
+		}
+	}
+	int32_t tag = Tagend;
+	fwrite(&tag, sizeof(tag), 1, f);
+}
+
+static Zone *zonereadb(FILE *f)
+{
+	Src s = { .f = f };
+	int kind;
+	if (!hdrread(&s, &kind))
+		return NULL;
+	return bodyread(f, kind, NULL);
+}
+
+// Reads what follows the magic number and version of a binary
+// zone of the given kind.  A streamed zone is copied to fwd, if
+// it isn't NULL, as it's read: the level as soon as it has been
+// read, so that the next stage can get started, and then each
+// record, but not the end tag.
+static Zone *bodyread(FILE *f, int kind, FILE *fwd)
+{
+	Lvl *lvl = kind == Zbpacked ? lvlreadp(f) : lvlreadb(f);
+	if (!lvl) {
+		seterrstr("Failed to read the level: %s", miderrstr());
+		return NULL;
+	}
+	Zone *zn = zonenew(lvl);
+
+	Src s = { .f = f };
+	_Bool ok;
+	if (kind == Zbstream) {
+		if (fwd) {
+			uint32_t v = Zbversion;
+			fwrite(Zsmagic, sizeof(Zsmagic), 1, fwd);
+			fwrite(&v, sizeof(v), 1, fwd);
+			lvlwriteb(fwd, lvl);
+			fflush(fwd);
+		}
+		ok = tagsread(&s, zn, fwd);
+	} else {
+		ok = recsread(&s, zn);
+	}
+	if (!ok) {
+		zonefree(zn);
+		return NULL;
+	}
+	return zn;
+}
+
+Zone *zonereadmap(void *p, unsigned long sz, void (*unmap)(void *, unsigned long))
+{
+	Src s = { .p = p, .end = (char *) p + sz };
+	int kind;
+	if (!hdrread(&s, &kind))
+		return NULL;
+	if (kind != Zbplain) {
+		seterrstr("Only a plain binary zone can be used in place");
+		return NULL;
+	}
+
+	unsigned long n;
+	Lvl *lvl = lvlreadmem(s.p, s.end - s.p, &n);
+	if (!lvl) {
+		seterrstr("Failed to read the level: %s", miderrstr());
+		return NULL;
+	}
+	s.p += n;
+	Zone *zn = zonenew(lvl);
+	if (!recsread(&s, zn)) {
+		zonefree(zn);
+		return NULL;
+	}
+
+	lvl->map = p;
+	lvl->mapsz = sz;
+	lvl->unmap = unmap;
+	return zn;
+}
+
+Zone *zonereadmem(const void *p, unsigned long sz)
+{
+	// Src only reads through p.
+	Src s = { .p = (char *) p, .end = (char *) p + sz };
+	int kind;
+	if (!hdrread(&s, &kind))
+		return NULL;
+	if (kind == Zbstream) {
+		seterrstr("A streamed zone can't be read from memory");
+		return NULL;
+	}
+
+	unsigned long n;
+	Lvl *lvl, *l;
+	if (kind == Zbpacked) {
+		lvl = lvlreadpmem(s.p, s.end - s.p, &n);
+	} else if ((lvl = lvlreadmem(s.p, s.end - s.p, &n))) {
+		// Copy the blocks out of p.
+		l = lvl;
+		lvl = lvlnew(l->d, l->w, l->h, l->seenz);
+		memcpy(lvl->blks, l->blks, sizeof(Blk) * ((size_t) l->d * l->w * l->h));
+		lvlfree(l);
+	}
+	if (!lvl) {
+		seterrstr("Failed to read the level: %s", miderrstr());
+		return NULL;
+	}
+	s.p += n;
+	Zone *zn = zonenew(lvl);
+	if (!recsread(&s, zn)) {
+		zonefree(zn);
+		return NULL;
+	}
+	return zn;
+}
+
+static _Bool srcread(Src *s, void *v, size_t n)
+{
+	if (s->f)
+		return fread(v, n, 1, s->f) == 1;
+	if ((size_t) (s->end - s->p) < n)
+		return false;
+	memcpy(v, s->p, n);
+	s->p += n;
+	return true;
+}
+
+static _Bool hdrread(Src *s, int *kind)
+{
+	char magic[sizeof(Zbmagic)];
+	uint32_t v;
+	if (!srcread(s, magic, sizeof(magic))) {
+		seterrstr("Bad binary zone magic number");
+		return false;
+	}
+	if (memcmp(magic, Zbmagic, sizeof(magic)) == 0)
+		*kind = Zbplain;
+	else if (memcmp(magic, Zpmagic, sizeof(magic)) == 0)
+		*kind = Zbpacked;
+	else if (memcmp(magic, Zsmagic, sizeof(magic)) == 0)
+		*kind = Zbstream;
+	else {
+		seterrstr("Bad binary zone magic number");
+		return false;
+	}
+	if (!srcread(s, &v, sizeof(v)) || v != Zbversion) {
+		seterrstr("Unsupported binary zone version");
+		return false;
+	}
+	return true;
+}
+
+// Reads the item, env and enemy records that follow the level.
+static _Bool recsread(Src *s, Zone *zn)
+{
+	uint32_t n[3];
+	if (!srcread(s, n, sizeof(n))) {
+		seterrstr("Failed to read the number of items, envs and enemies");
+		return false;
+	}
+	for (uint32_t i = 0; i < n[0]; i++) {
+		Itemrec r;
+		if (!srcread(s, &r, sizeof(r))) {
+			seterrstr("Failed to read item %u", i);
+			return false;
+		}
+		if (!itemadd(zn, &r, i))
+			return false;
+	}
+	for (uint32_t i = 0; i < n[1]; i++) {
+		Envrec r;
+		if (!srcread(s, &r, sizeof(r))) {
+			seterrstr("Failed to read env %u", i);
+			return false;
+		}
+		if (!envadd(zn, &r, i))
+			return false;
+	}
+	for (uint32_t i = 0; i < n[2]; i++) {
+		Enemyrec r;
+		if (!srcread(s, &r, sizeof(r))) {
+			seterrstr("Failed to read enemy %u", i);
+			return false;
+		}
+		if (!enemyadd(zn, &r, i))
+			return false;
+	}
+	return true;
+}
+
+// Reads tagged records up to the end tag, copying each to fwd
+// if it isn't NULL.
+static _Bool tagsread(Src *s, Zone *zn, FILE *fwd)
+{
+	for (uint32_t i = 0; ; i++) {
+		int32_t tag;
+		if (!srcread(s, &tag, sizeof(tag))) {
+			seterrstr("Failed to read the tag of record %u", i);
+			return false;
+		}
+
+		union {
+			Itemrec it;
+			Envrec env;
+			Enemyrec enm;
+		} r;
+		size_t sz;
+		switch (tag) {
+		case Tagend:
+			return true;
+		case Tagitem:
+			sz = sizeof(r.it);
+			break;
+		case Tagenv:
+			sz = sizeof(r.env);
+			break;
+		case Tagenemy:
+			sz = sizeof(r.enm);
+			break;
+		default:
+			seterrstr("Bad tag %d of record %u", tag, i);
+			return false;
+		}
+		if (!srcread(s, &r, sz)) {
+			seterrstr("Failed to read record %u", i);
+			return false;
+		}
+
+		_Bool ok = tag == Tagitem ? itemadd(zn, &r.it, i)
+			: tag == Tagenv ? envadd(zn, &r.env, i)
+			: enemyadd(zn, &r.enm, i);
+		if (!ok)
+			return false;
+		if (fwd) {
+			fwrite(&tag, sizeof(tag), 1, fwd);
+			fwrite(&r, sz, 1, fwd);
+		}
+	}
+}
+
+static _Bool itemadd(Zone *zn, Itemrec *r, uint32_t i)
+{
+	Item it = { .id = r->id, .body = recbody(r->body) };
+	if (r->id <= 0 || r->id >= ItemMax || !zoneadditem(zn, r->z, it)) {
+		seterrstr("Failed to add item %u: bad ID or too many items", i);
+		return false;
+	}
+	return true;
+}
+
+static _Bool envadd(Zone *zn, Envrec *r, uint32_t i)
+{
+	Env env = {
+		.id = r->id, .body = recbody(r->body),
+		.gotit = r->gotit, .min = r->min,
+	};
+	if (r->id <= 0 || r->id >= EnvMax || !zoneaddenv(zn, r->z, env)) {
+		seterrstr("Failed to add env %u: bad ID or too many envs", i);
+		return false;
+	}
+	return true;
+}
+
+static _Bool enemyadd(Zone *zn, Enemyrec *r, uint32_t i)
+{
+	Enemy enm;
+	int aux[Enemyaux];
+	for (int j = 0; j < Enemyaux; j++)
+		aux[j] = r->aux[j];
+	if (!enemyload(&enm, r->id, recbody(r->body), r->hp, aux)) {
+		seterrstr("Failed to load enemy %u with ID %d", i, r->id);
+		return false;
+	}
+	if (!zoneaddenemy(zn, r->z, enm)) {
+		enemyfree(&enm);
+		seterrstr("Failed to add enemy %u: too many enemies", i);
+		return false;
+	}
+	return true;
+}
+
+static Itemrec itemrec(int z, Item *it)
+{
+	return (Itemrec) { .z = z, .id = it->id, .body = bodyrec(it->body) };
+}
+
+static Envrec envrec(int z, Env *env)
+{
+	return (Envrec) {
+		.z = z, .id = env->id, .gotit = env->gotit, .min = env->min,
+		.body = bodyrec(env->body),
+	};
+}
+
+static Enemyrec enemyrec(int z, Enemy *enm)
+{
+	Enemyrec r = { .z = z, .id = enm->id, .hp = enm->hp, .body = bodyrec(enm->body) };
+	int aux[Enemyaux];
+	enemyaux(enm, aux);
+	for (int j = 0; j < Enemyaux; j++)
+		r.aux[j] = aux[j];
+	return r;
+}
+
+static Bodyrec bodyrec(Body b)
+{
+	return (Bodyrec) {
+		.bbox = { b.bbox.a.x, b.bbox.a.y, b.bbox.b.x, b.bbox.b.y },
+		.vel = { b.vel.x, b.vel.y },
+		.acc = { b.acc.x, b.acc.y },
+		.fall = b.fall,
+	};
+}
+
+static Body recbody(Bodyrec r)
+{
+	return (Body) {
+		.bbox = { { r.bbox[0], r.bbox[1] }, { r.bbox[2], r.bbox[3] } },
+		.vel = { r.vel[0], r.vel[1] },
+		.acc = { r.acc[0], r.acc[1] },
+		.fall = r.fall,
+	};
+}
+
 _Bool zoneadditem(Zone *zn, int z, Item it)
 {
+	if (z < 0 || z >= zn->lvl->d)
+		return false;
+
 	int oldz = zn->lvl->z;
 
 	zn->lvl->z = z;
@@ -199,11 +833,15 @@ _Bool zoneadditem(Zone *zn, int z, Item it)
 		return false;
 
 	zn->itms[z][i] = it;
+	occmark(zn, z, it.body.bbox, Occitem, i);
 	return true;
 }
 
 _Bool zoneaddenv(Zone *zn, int z, Env env)
 {
+	if (z < 0 || z >= zn->lvl->d)
+		return false;
+
 	int i;
 	Env *envs = zn->envs[z];
 
@@ -213,11 +851,15 @@ _Bool zoneaddenv(Zone *zn, int z, Env env)
 		return false;
 
 	zn->envs[z][i] = env;
+	occmark(zn, z, env.body.bbox, Occenv, i);
 	return true;
 }
 
 _Bool zoneaddenemy(Zone *zn, int z, Enemy enm)
 {
+	if (z < 0 || z >= zn->lvl->d)
+		return false;
+
 	int i;
 	Enemy *enms = zn->enms[z];
 
@@ -227,11 +869,15 @@ _Bool zoneaddenemy(Zone *zn, int z, Enemy enm)
 		return false;
 
 	zn->enms[z][i] = enm;
+	occmark(zn, z, enm.body.bbox, Occenemy, i);
 	return true;
 }
 
 _Bool zoneaddmagic(Zone *zn, int z, Magic mag)
 {
+	if (z < 0 || z >= zn->lvl->d)
+		return false;
+
 	int i;
 	Magic *mags = zn->mags[z];
 
@@ -248,24 +894,24 @@ _Bool zoneaddmagic(Zone *zn, int z, Magic mag)
 void zonefree(Zone *z)
 {
 	lvlfree(z->lvl);
-	free(z);
+	xfree(z->itms);
+	xfree(z->envs);
+	xfree(z->enms);
+	xfree(z->mags);
+	occfree(z->occ);
+	xfree(z->dist);
+	xfree(z);
 }
 
-int zonelocs(Zone *zn, int z, _Bool (*p)(Zone *, int, Point), Point pts[], int sz)
+int zonedist(Zone *zn, int z, Point pt)
 {
-	int n = 0;
-	Point pt;
-
-	for (pt.x = 0; pt.x < zn->lvl->w; pt.x++) {
-	for (pt.y = 0; pt.y < zn->lvl->h; pt.y++) {
-		if (n >= sz || !p(zn, z, pt))
-			continue;
-		pts[n] = pt;
-		n++;
-	}
-	}
-
-	return n;
+	Lvl *l = zn->lvl;
+	int x = pt.x, y = pt.y;
+	if (z < 0 || z >= l->d || x < 0 || x >= l->w || y < 0 || y >= l->h)
+		return -1;
+	if (!zn->dist)
+		distfill(zn);
+	return zn->dist[((size_t) z * l->h + y) * l->w + x];
 }
 
 // Is there a block contained in the area from loc with width-height
@@ -310,27 +956,27 @@ _Bool zoneoverlap(Zone *zn, int z, Point loc, Point wh)
 	loc.y *= Theight;
 	Rect r = (Rect) { loc, (Point) { loc.x + wh.x, loc.y + wh.y } };
 
-	for (int i = 0; i < Maxitms; i++) {
-		Item *it = &zn->itms[z][i];
-		if (it->id && isect(r, it->body.bbox))
-			return true;
-	}
-	for (int i = 0; i < Maxenvs; i++) {
-		Env *en = &zn->envs[z][i];
-		if (en->id && isect(r, en->body.bbox))
-			return true;
+	// Any two rects that isect() share a block, so only the
+	// things touching the blocks of r need to be checked.
+	int x0, y0, x1, y1;
+	if (!occrange(zn->lvl, r, &x0, &y0, &x1, &y1))
+		return false;
+	for (int y = y0; y <= y1; y++) {
+	for (int x = x0; x <= x1; x++) {
+		int *p = NULL;
+		Rect bbox;
+		while ((p = occnext(zn, z, x, y, p, &bbox))) {
+			if (isect(r, bbox))
+				return true;
+		}
 	}
-	for (int i = 0; i < Maxenms; i++) {
-		Enemy *en = &zn->enms[z][i];
-		if (en->id && isect(r, en->body.bbox))
-			return true;
 	}
-
 	return false;
 }
 
 void zoneupdate(Zone *zn, Player *p, Msg *m)
 {
+	zn->dirty = true;
 	lvlupdate(zn->lvl);
 	playerupdate(p, zn);
 
@@ -449,3 +1095,180 @@ static _Bool blkflgszero(Lvl *lvl, int y, int z)
 
 	return true;
 }
+
+static Occ *occnew(Lvl *lvl)
+{
+	Occ *o = xalloc(1, sizeof(*o));
+	o->head = xalloc((size_t) lvl->d * lvl->w * lvl->h, sizeof(o->head[0]));
+	return o;
+}
+
+static Occ *occcopy(Occ *o, Lvl *lvl)
+{
+	Occ *c = occnew(lvl);
+	memcpy(c->head, o->head, (size_t) lvl->d * lvl->w * lvl->h * sizeof(o->head[0]));
+	if (o->sz > 0) {
+		c->refs = xalloc(o->sz, sizeof(o->refs[0]));
+		memcpy(c->refs, o->refs, o->n * sizeof(o->refs[0]));
+	}
+	c->n = o->n;
+	c->sz = o->sz;
+	c->free = o->free;
+	return c;
+}
+
+static void occfree(Occ *o)
+{
+	if (!o)
+		return;
+	xfree(o->head);
+	xfree(o->refs);
+	xfree(o);
+}
+
+// Adds the thing of the given kind at index i of layer z to the
+// blocks touched by its bounding box r.
+static void occmark(Zone *zn, int z, Rect r, int kind, int i)
+{
+	Occ *o = zn->occ;
+	int x0, y0, x1, y1;
+	if (!occrange(zn->lvl, r, &x0, &y0, &x1, &y1))
+		return;
+	for (int y = y0; y <= y1; y++) {
+	for (int x = x0; x <= x1; x++) {
+		// Walking the block's list drops the things no longer
+		// on it, which bounds it by the things that are.
+		int *p = NULL;
+		Rect bbox;
+		while ((p = occnext(zn, z, x, y, p, &bbox)))
+			;
+
+		int k = o->free;
+		if (k) {
+			o->free = o->refs[k - 1].next;
+		} else {
+			if (o->n == o->sz) {
+				o->sz = o->sz ? 2 * o->sz : 64;
+				Occref *refs = xalloc(o->sz, sizeof(*refs));
+				if (o->refs)
+					memcpy(refs, o->refs, o->n * sizeof(*refs));
+				xfree(o->refs);
+				o->refs = refs;
+			}
+			k = ++o->n;
+		}
+		int *h = &o->head[((size_t) z * zn->lvl->h + y) * zn->lvl->w + x];
+		o->refs[k - 1] = (Occref) { .next = *h, .kind = kind, .i = i };
+		*h = k;
+	}
+	}
+}
+
+// Iterates over the things on block x, y of layer z: given NULL
+// or the link returned for the previous thing, returns the link
+// to the next one, setting bbox to its bounding box, or NULL
+// after the last.  Things that have gone away or no longer touch
+// the block are unlinked along the way.
+static int *occnext(Zone *zn, int z, int x, int y, int *p, Rect *bbox)
+{
+	Occ *o = zn->occ;
+	p = p ? &o->refs[*p - 1].next : &o->head[((size_t) z * zn->lvl->h + y) * zn->lvl->w + x];
+	while (*p) {
+		int k = *p;
+		Occref *ref = &o->refs[k - 1];
+		int x0, y0, x1, y1;
+		if (occbbox(zn, z, ref, bbox) && occrange(zn->lvl, *bbox, &x0, &y0, &x1, &y1)
+				&& x0 <= x && x <= x1 && y0 <= y && y <= y1)
+			return p;
+		*p = ref->next;
+		ref->next = o->free;
+		o->free = k;
+	}
+	return NULL;
+}
+
+// Gets the bounding box of the thing, returning false if it has
+// gone away.
+static _Bool occbbox(Zone *zn, int z, Occref *ref, Rect *bbox)
+{
+	switch (ref->kind) {
+	case Occitem:
+		*bbox = zn->itms[z][ref->i].body.bbox;
+		return zn->itms[z][ref->i].id != 0;
+	case Occenv:
+		*bbox = zn->envs[z][ref->i].body.bbox;
+		return zn->envs[z][ref->i].id != 0;
+	default:
+		*bbox = zn->enms[z][ref->i].body.bbox;
+		return zn->enms[z][ref->i].id != 0;
+	}
+}
+
+/* Gets the range of blocks touched by r, including those that
+ * its edges only touch, clipped to the level.  Any two rects
+ * that isect() share a point, so they share a block too.
+ * Returns false if r is entirely outside of the level, or if
+ * it isn't finite, as a box read from a bad file may not be. */
+static _Bool occrange(Lvl *lvl, Rect r, int *x0, int *y0, int *x1, int *y1)
+{
+	Line1d x = rectprojx(r), y = rectprojy(r);
+	if (!isfinite(x.a) || !isfinite(x.b) || !isfinite(y.a) || !isfinite(y.b))
+		return false;
+
+	// Clip before converting, so that the blocks fit in an int.
+	double w = (double) lvl->w * Twidth, h = (double) lvl->h * Theight;
+	if (x.b < 0 || y.b < 0 || x.a >= w || y.a >= h)
+		return false;
+	*x0 = x.a < 0 ? 0 : floor(x.a / Twidth);
+	*y0 = y.a < 0 ? 0 : floor(y.a / Theight);
+	*x1 = x.b >= w ? lvl->w - 1 : floor(x.b / Twidth);
+	*y1 = y.b >= h ? lvl->h - 1 : floor(y.b / Theight);
+	return true;
+}
+
+// Breadth-first search from every up-stairs block over the
+// blocks that don't collide.  Blocks are adjacent if they are
+// side by side or above one another on the same layer, or if
+// a door on one leads to the other.
+static void distfill(Zone *zn)
+{
+	Lvl *l = zn->lvl;
+	size_t n = (size_t) l->d * l->w * l->h;
+	int *dist = xalloc(n, sizeof(*dist));
+	size_t *q = xalloc(n, sizeof(*q));
+	size_t qh = 0, qt = 0;
+
+	for (size_t i = 0; i < n; i++) {
+		dist[i] = -1;
+		if (tileinfo(l, i % l->w, i / l->w % l->h, i / l->w / l->h).flags & Tup) {
+			dist[i] = 0;
+			q[qt++] = i;
+		}
+	}
+
+	while (qh < qt) {
+		size_t i = q[qh++];
+		int x = i % l->w, y = i / l->w % l->h, z = i / l->w / l->h;
+		unsigned int f = tileinfo(l, x, y, z).flags;
+
+		int nbrs[][3] = {
+			{ x - 1, y, z }, { x + 1, y, z },
+			{ x, y - 1, z }, { x, y + 1, z },
+			{ x, y, f & Tbdoor ? z + 1 : -1 },
+			{ x, y, f & Tfdoor ? z - 1 : -1 },
+		};
+		for (int j = 0; j < (int) (sizeof(nbrs) / sizeof(nbrs[0])); j++) {
+			int nx = nbrs[j][0], ny = nbrs[j][1], nz = nbrs[j][2];
+			if (nx < 0 || nx >= l->w || ny < 0 || ny >= l->h || nz < 0 || nz >= l->d)
+				continue;
+			size_t k = ((size_t) nz * l->h + ny) * l->w + nx;
+			if (dist[k] >= 0 || tileinfo(l, nx, ny, nz).flags & Tcollide)
+				continue;
+			dist[k] = dist[i] + 1;
+			q[qt++] = k;
+		}
+	}
+
+	xfree(q);
+	zn->dist = dist;
+}
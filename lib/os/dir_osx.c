@@ -3,7 +3,22 @@
 #include <stdio.h>
 #include "../../include/os.h"
 #include <sys/stat.h>
+#include <unistd.h>
 
 int makedir(const char *dir){
 	return mkdir(dir, 0700);
 }
+
+int syncfile(FILE *f){
+	if(fflush(f) != 0)
+		return -1;
+	return fsync(fileno(f));
+}
+
+long readat(FILE *f, void *buf, unsigned long n, long long off){
+	return pread(fileno(f), buf, n, off);
+}
+
+int renameover(const char *from, const char *to){
+	return rename(from, to);
+}
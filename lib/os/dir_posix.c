@@ -1,9 +1,26 @@
 /* © 2013 the Mid Authors under the MIT license. See AUTHORS for the list of authors.*/
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include "../../include/os.h"
 #include <sys/stat.h>
+#include <unistd.h>
 
 int makedir(const char *dir){
 	return mkdir(dir, 0700);
 }
+
+int syncfile(FILE *f){
+	if(fflush(f) != 0)
+		return -1;
+	return fsync(fileno(f));
+}
+
+long readat(FILE *f, void *buf, unsigned long n, long long off){
+	return pread(fileno(f), buf, n, off);
+}
+
+int renameover(const char *from, const char *to){
+	return rename(from, to);
+}
@@ -3,7 +3,29 @@
 #include <stdio.h>
 #include "../../include/os.h"
 #include <dirent.h>
+#include <io.h>
+#include <windows.h>
 
 int makedir(const char *dir){
 	return _mkdir(dir);
 }
+
+int syncfile(FILE *f){
+	if(fflush(f) != 0)
+		return -1;
+	return _commit(_fileno(f));
+}
+
+long readat(FILE *f, void *buf, unsigned long n, long long off){
+	int fd = _fileno(f);
+	if(_lseeki64(fd, off, SEEK_SET) < 0)
+		return -1;
+	return _read(fd, buf, n);
+}
+
+// Rename won't replace an existing file on Windows.
+int renameover(const char *from, const char *to){
+	if(!MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+		return -1;
+	return 0;
+}
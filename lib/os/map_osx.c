@@ -0,0 +1,31 @@
+/* © 2013 the Mid Authors under the MIT license. See AUTHORS for the list of authors.*/
+
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "../../include/os.h"
+
+void *mapfile(const char *path, unsigned long *sz){
+	int fd = open(path, O_RDONLY);
+	if(fd < 0)
+		return NULL;
+	struct stat st;
+	if(fstat(fd, &st) < 0 || st.st_size == 0){
+		close(fd);
+		return NULL;
+	}
+	// The mapping outlives the descriptor.
+	void *p = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(p == MAP_FAILED)
+		return NULL;
+	*sz = st.st_size;
+	return p;
+}
+
+void unmapfile(void *p, unsigned long sz){
+	munmap(p, sz);
+}
@@ -0,0 +1,31 @@
+/* © 2013 the Mid Authors under the MIT license. See AUTHORS for the list of authors.*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "../../include/os.h"
+
+// Windows won't replace a file that has a view mapped, and the
+// zone files are replaced while their zones are in use, so the
+// file is read into memory instead.
+void *mapfile(const char *path, unsigned long *sz){
+	FILE *f = fopen(path, "rb");
+	if(!f)
+		return NULL;
+	void *p = NULL;
+	long n;
+	if(fseek(f, 0, SEEK_END) < 0 || (n = ftell(f)) <= 0 || fseek(f, 0, SEEK_SET) < 0)
+		goto out;
+	p = malloc(n);
+	if(p && fread(p, 1, n, f) != (size_t) n){
+		free(p);
+		p = NULL;
+	}
+	*sz = n;
+out:
+	fclose(f);
+	return p;
+}
+
+void unmapfile(void *p, unsigned long sz){
+	free(p);
+}
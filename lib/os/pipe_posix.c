@@ -1,11 +1,42 @@
 /* © 2013 the Mid Authors under the MIT license. See AUTHORS for the list of authors.*/
 
-#define _POSIX_SOURCE
+#define _DEFAULT_SOURCE
 #define _POSIX_C_SOURCE 200112L
+#define _XOPEN_SOURCE 600
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <spawn.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#include <sys/resource.h>
 #include "../../include/os.h"
 
+extern char **environ;
+
+/* A stage of a Pipeln.  The waiter thread waits for the stage to
+ * exit, without reaping it, and sets end. */
+typedef struct Stage Stage;
+struct Stage{
+	pid_t pid;
+	double start, end;
+	Thrd *waiter;
+};
+
+struct Pipeln{
+	int n;
+	Stage *stages;
+	FILE *out;
+};
+
+static void waitexit(void *);
+static long long wchar(pid_t);
+
 FILE *piperead(const char *cmd){
 	return popen(cmd, "r");
 }
@@ -13,3 +44,138 @@ FILE *piperead(const char *cmd){
 int pipeclose(FILE *p){
 	return pclose(p);
 }
+
+Pipeln *pipelnopen(char *const *argvs[], int n){
+	Pipeln *p = calloc(1, sizeof(*p));
+	if(!p)
+		return NULL;
+	p->stages = calloc(n, sizeof(p->stages[0]));
+	if(!p->stages)
+		goto err;
+
+	// The pipe ends are close-on-exec, so each stage keeps only
+	// the ends that are dup'd onto its standard input and output.
+	int in = -1;
+	for(int i = 0; i < n; i++){
+		int fds[2];
+		if(pipe(fds) < 0)
+			goto err;
+		fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+		fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+
+		posix_spawn_file_actions_t fa;
+		posix_spawn_file_actions_init(&fa);
+		if(in >= 0)
+			posix_spawn_file_actions_adddup2(&fa, in, 0);
+		posix_spawn_file_actions_adddup2(&fa, fds[1], 1);
+
+		Stage *s = &p->stages[i];
+		s->start = clockms();
+		s->end = -1;
+		int err = posix_spawnp(&s->pid, argvs[i][0], &fa, NULL, argvs[i], environ);
+		posix_spawn_file_actions_destroy(&fa);
+		close(fds[1]);
+		if(in >= 0)
+			close(in);
+		in = fds[0];
+		if(err != 0){
+			close(in);
+			errno = err;
+			goto err;
+		}
+		p->n++;
+		s->waiter = thrdnew(waitexit, s);
+	}
+
+	p->out = fdopen(in, "r");
+	if(!p->out){
+		close(in);
+		goto err;
+	}
+	return p;
+err:
+	if(p->stages){
+		int e = errno;
+		for(int i = 0; i < p->n; i++){
+			waitpid(p->stages[i].pid, NULL, 0);
+			if(p->stages[i].waiter)
+				thrdjoin(p->stages[i].waiter);
+		}
+		errno = e;
+	}
+	free(p->stages);
+	free(p);
+	return NULL;
+}
+
+FILE *pipelnout(Pipeln *p){
+	return p->out;
+}
+
+int pipelnclose(Pipeln *p, Pipestat st[]){
+	fclose(p->out);
+
+	int ret = 0;
+	for(int i = 0; i < p->n; i++){
+		Stage *sg = &p->stages[i];
+		Pipestat s = { .start = sg->start, .end = -1, .status = -1, .bytes = -1 };
+
+		// Wait without reaping, so that the stage's I/O
+		// accounting can still be read.
+		siginfo_t si;
+		if(waitid(P_PID, sg->pid, &si, WEXITED | WNOWAIT) == 0)
+			s.bytes = wchar(sg->pid);
+		if(sg->waiter){
+			thrdjoin(sg->waiter);
+			s.end = sg->end;
+		}
+
+		int stat;
+		struct rusage ru;
+		if(wait4(sg->pid, &stat, 0, &ru) == sg->pid){
+			s.cpums = ru.ru_utime.tv_sec * 1e3 + ru.ru_utime.tv_usec / 1e3
+				+ ru.ru_stime.tv_sec * 1e3 + ru.ru_stime.tv_usec / 1e3;
+			if(WIFEXITED(stat))
+				s.status = WEXITSTATUS(stat);
+		}
+		if(s.status != 0)
+			ret = -1;
+		if(st)
+			st[i] = s;
+	}
+
+	free(p->stages);
+	free(p);
+	return ret;
+}
+
+// Waits for the stage to exit, while its output is still being
+// read, so that its end is when it exited and not when the
+// pipeline was closed.
+static void waitexit(void *arg){
+	Stage *s = arg;
+	siginfo_t si;
+	int r;
+	while((r = waitid(P_PID, s->pid, &si, WEXITED | WNOWAIT)) < 0 && errno == EINTR)
+		;
+	if(r == 0)
+		s->end = clockms();
+}
+
+// Returns the bytes that the process has written, from Linux's
+// /proc/<pid>/io, or -1 if they aren't known.
+static long long wchar(pid_t pid){
+	char path[64];
+	snprintf(path, sizeof(path), "/proc/%d/io", (int) pid);
+	FILE *f = fopen(path, "r");
+	if(!f)
+		return -1;
+	long long n = -1;
+	char l[128];
+	while(fgets(l, sizeof(l), f)){
+		if(sscanf(l, "wchar: %lld", &n) == 1)
+			break;
+	}
+	fclose(f);
+	return n;
+}
@@ -2,8 +2,16 @@
 
 #undef __STRICT_ANSI__
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "../../include/os.h"
 
+struct Pipeln{
+	int n;
+	double start;
+	FILE *out;
+};
+
 FILE *piperead(const char *cmd){
 	return _popen(cmd, "r");
 }
@@ -11,3 +19,56 @@ FILE *piperead(const char *cmd){
 int pipeclose(FILE *p){
 	return _pclose(p);
 }
+
+// Windows has no posix_spawn, so the stages are joined into one
+// command line, which is as long as it needs to be, and run by
+// the shell.  Only the exit status of the last stage is known,
+// and not when any of the stages exited.
+Pipeln *pipelnopen(char *const *argvs[], int n){
+	size_t sz = 1;
+	for(int i = 0; i < n; i++){
+		for(char *const *a = argvs[i]; *a; a++)
+			sz += strlen(*a) + 3;
+		sz += 3;
+	}
+	char *cmd = malloc(sz);
+	Pipeln *p = calloc(1, sizeof(*p));
+	if(!cmd || !p){
+		free(cmd);
+		free(p);
+		return NULL;
+	}
+
+	char *c = cmd;
+	for(int i = 0; i < n; i++){
+		if(i > 0)
+			c += sprintf(c, "| ");
+		for(char *const *a = argvs[i]; *a; a++)
+			c += sprintf(c, "\"%s\" ", *a);
+	}
+
+	p->n = n;
+	p->start = clockms();
+	p->out = _popen(cmd, "r");
+	free(cmd);
+	if(!p->out){
+		free(p);
+		return NULL;
+	}
+	return p;
+}
+
+FILE *pipelnout(Pipeln *p){
+	return p->out;
+}
+
+int pipelnclose(Pipeln *p, Pipestat st[]){
+	int stat = _pclose(p->out);
+	for(int i = 0; st && i < p->n; i++){
+		st[i] = (Pipestat){ .start = p->start, .end = -1, .status = -1, .bytes = -1 };
+		if(i == p->n - 1)
+			st[i].status = stat;
+	}
+	free(p);
+	return stat == 0 ? 0 : -1;
+}
@@ -0,0 +1,66 @@
+/* © 2013 the Mid Authors under the MIT license. See AUTHORS for the list of authors.*/
+
+#define _GNU_SOURCE
+#define _POSIX_C_SOURCE 200112L
+#define _XOPEN_SOURCE 600
+
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <spawn.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "../../include/os.h"
+
+extern char **environ;
+
+/* The background processes that haven't been reaped. */
+enum { Maxbg = 16 };
+static pid_t bgpids[Maxbg];
+static int nbg;
+
+static void reapbg(void);
+
+int spawnbg(char *const argv[]){
+	reapbg();
+	if(nbg == Maxbg){
+		errno = EAGAIN;
+		return -1;
+	}
+
+	posix_spawnattr_t at;
+	posix_spawnattr_init(&at);
+	// Start it in a session of its own, so that it isn't sent the
+	// terminal's signals, such as the interrupt, meant for mid.
+#ifdef POSIX_SPAWN_SETSID
+	posix_spawnattr_setflags(&at, POSIX_SPAWN_SETSID);
+#else
+	posix_spawnattr_setflags(&at, POSIX_SPAWN_SETPGROUP);
+	posix_spawnattr_setpgroup(&at, 0);
+#endif
+	pid_t pid;
+	int err = posix_spawnp(&pid, argv[0], NULL, &at, argv, environ);
+	posix_spawnattr_destroy(&at);
+	if(err != 0){
+		errno = err;
+		return -1;
+	}
+	bgpids[nbg++] = pid;
+	return 0;
+}
+
+// Reaps the background processes that have exited, so that they
+// aren't left as zombies.
+static void reapbg(void){
+	for(int i = 0; i < nbg; ){
+		int st;
+		if(waitpid(bgpids[i], &st, WNOHANG) != 0)
+			bgpids[i] = bgpids[--nbg];
+		else
+			i++;
+	}
+}
+
+int lowprio(void){
+	return nice(10) == -1 ? -1 : 0;
+}
@@ -0,0 +1,14 @@
+/* © 2013 the Mid Authors under the MIT license. See AUTHORS for the list of authors.*/
+
+#include <stdio.h>
+#include <process.h>
+#include <windows.h>
+#include "../../include/os.h"
+
+int spawnbg(char *const argv[]){
+	return _spawnvp(_P_NOWAIT, argv[0], (const char *const *) argv) == -1 ? -1 : 0;
+}
+
+int lowprio(void){
+	return SetPriorityClass(GetCurrentProcess(), BELOW_NORMAL_PRIORITY_CLASS) ? 0 : -1;
+}
@@ -0,0 +1,149 @@
+/* © 2013 the Mid Authors under the MIT license. See AUTHORS for the list of authors.*/
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include "../../include/os.h"
+
+struct Thrd{
+	pthread_t t;
+	void (*f)(void*);
+	void *arg;
+};
+
+struct Mtx{
+	pthread_mutex_t m;
+};
+
+struct Cnd{
+	pthread_cond_t c;
+};
+
+static void *thrdstart(void *p){
+	Thrd *t = p;
+	t->f(t->arg);
+	return NULL;
+}
+
+Thrd *thrdnew(void (*f)(void*), void *arg){
+	Thrd *t = malloc(sizeof(*t));
+	if(!t)
+		return NULL;
+	t->f = f;
+	t->arg = arg;
+	if(pthread_create(&t->t, NULL, thrdstart, t) != 0){
+		free(t);
+		return NULL;
+	}
+	return t;
+}
+
+void thrdjoin(Thrd *t){
+	pthread_join(t->t, NULL);
+	free(t);
+}
+
+Mtx *mtxnew(void){
+	Mtx *m = malloc(sizeof(*m));
+	if(!m)
+		return NULL;
+	if(pthread_mutex_init(&m->m, NULL) != 0){
+		free(m);
+		return NULL;
+	}
+	return m;
+}
+
+void mtxfree(Mtx *m){
+	pthread_mutex_destroy(&m->m);
+	free(m);
+}
+
+void mtxlock(Mtx *m){
+	pthread_mutex_lock(&m->m);
+}
+
+void mtxunlock(Mtx *m){
+	pthread_mutex_unlock(&m->m);
+}
+
+Cnd *cndnew(void){
+	Cnd *c = malloc(sizeof(*c));
+	if(!c)
+		return NULL;
+
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	int err = pthread_cond_init(&c->c, &attr);
+	pthread_condattr_destroy(&attr);
+	if(err != 0){
+		free(c);
+		return NULL;
+	}
+	return c;
+}
+
+void cndfree(Cnd *c){
+	pthread_cond_destroy(&c->c);
+	free(c);
+}
+
+void cndwait(Cnd *c, Mtx *m){
+	pthread_cond_wait(&c->c, &m->m);
+}
+
+int cndwaitms(Cnd *c, Mtx *m, double ms){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	long long ns = ts.tv_nsec + (long long) (ms * 1e6);
+	ts.tv_sec += ns / 1000000000;
+	ts.tv_nsec = ns % 1000000000;
+	return pthread_cond_timedwait(&c->c, &m->m, &ts) == ETIMEDOUT;
+}
+
+void cndbcast(Cnd *c){
+	pthread_cond_broadcast(&c->c);
+}
+
+enum { Paint = 0xA5 };
+
+long stkpeak(void (*f)(void*), void *arg, unsigned long stksz){
+	void *stk;
+	if(posix_memalign(&stk, 4096, stksz) != 0)
+		return -1;
+	memset(stk, Paint, stksz);
+
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	Thrd t = { .f = f, .arg = arg };
+	int err = pthread_attr_setstack(&attr, stk, stksz);
+	if(err == 0)
+		err = pthread_create(&t.t, &attr, thrdstart, &t);
+	pthread_attr_destroy(&attr);
+	if(err != 0){
+		free(stk);
+		return -1;
+	}
+	pthread_join(t.t, NULL);
+
+	// The stack grows down, so the lowest byte that is no
+	// longer painted marks the deepest point it reached.
+	unsigned char *p = stk;
+	unsigned long i = 0;
+	while(i < stksz && p[i] == Paint)
+		i++;
+	free(stk);
+	return stksz - i;
+}
+
+double clockms(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
@@ -0,0 +1,141 @@
+/* © 2013 the Mid Authors under the MIT license. See AUTHORS for the list of authors.*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <windows.h>
+#include "../../include/os.h"
+
+struct Thrd{
+	HANDLE h;
+	void (*f)(void*);
+	void *arg;
+};
+
+struct Mtx{
+	CRITICAL_SECTION cs;
+};
+
+struct Cnd{
+	CONDITION_VARIABLE cv;
+};
+
+static DWORD WINAPI thrdstart(LPVOID p){
+	Thrd *t = p;
+	t->f(t->arg);
+	return 0;
+}
+
+Thrd *thrdnew(void (*f)(void*), void *arg){
+	Thrd *t = malloc(sizeof(*t));
+	if(!t)
+		return NULL;
+	t->f = f;
+	t->arg = arg;
+	t->h = CreateThread(NULL, 0, thrdstart, t, 0, NULL);
+	if(!t->h){
+		free(t);
+		return NULL;
+	}
+	return t;
+}
+
+void thrdjoin(Thrd *t){
+	WaitForSingleObject(t->h, INFINITE);
+	CloseHandle(t->h);
+	free(t);
+}
+
+Mtx *mtxnew(void){
+	Mtx *m = malloc(sizeof(*m));
+	if(!m)
+		return NULL;
+	InitializeCriticalSection(&m->cs);
+	return m;
+}
+
+void mtxfree(Mtx *m){
+	DeleteCriticalSection(&m->cs);
+	free(m);
+}
+
+void mtxlock(Mtx *m){
+	EnterCriticalSection(&m->cs);
+}
+
+void mtxunlock(Mtx *m){
+	LeaveCriticalSection(&m->cs);
+}
+
+Cnd *cndnew(void){
+	Cnd *c = malloc(sizeof(*c));
+	if(!c)
+		return NULL;
+	InitializeConditionVariable(&c->cv);
+	return c;
+}
+
+void cndfree(Cnd *c){
+	free(c);
+}
+
+void cndwait(Cnd *c, Mtx *m){
+	SleepConditionVariableCS(&c->cv, &m->cs, INFINITE);
+}
+
+int cndwaitms(Cnd *c, Mtx *m, double ms){
+	if(SleepConditionVariableCS(&c->cv, &m->cs, (DWORD) ms))
+		return 0;
+	return GetLastError() == ERROR_TIMEOUT;
+}
+
+void cndbcast(Cnd *c){
+	WakeAllConditionVariable(&c->cv);
+}
+
+typedef struct Stkpeak Stkpeak;
+struct Stkpeak{
+	Thrd t;
+	long peak;
+};
+
+static DWORD WINAPI stkpeakstart(LPVOID p){
+	Stkpeak *s = p;
+	s->t.f(s->t.arg);
+
+	// Stack pages are committed as the stack grows, and never
+	// released, so the committed pages below the top of the
+	// stack are the most that the thread has used.
+	MEMORY_BASIC_INFORMATION mbi;
+	if(VirtualQuery(&mbi, &mbi, sizeof(mbi)) == 0){
+		s->peak = -1;
+		return 0;
+	}
+	char *top = (char*) mbi.BaseAddress + mbi.RegionSize;
+	char *p = mbi.AllocationBase;
+	while(p < top && VirtualQuery(p, &mbi, sizeof(mbi)) != 0){
+		if(mbi.State == MEM_COMMIT && !(mbi.Protect & PAGE_GUARD))
+			break;
+		p = (char*) mbi.BaseAddress + mbi.RegionSize;
+	}
+	s->peak = top - p;
+	return 0;
+}
+
+long stkpeak(void (*f)(void*), void *arg, unsigned long stksz){
+	Stkpeak s = { .t = { .f = f, .arg = arg } };
+	HANDLE h = CreateThread(NULL, stksz, stkpeakstart, &s, STACK_SIZE_PARAM_IS_A_RESERVATION, NULL);
+	if(!h)
+		return -1;
+	WaitForSingleObject(h, INFINITE);
+	CloseHandle(h);
+	return s.peak;
+}
+
+double clockms(void){
+	static LARGE_INTEGER freq;
+	if(freq.QuadPart == 0)
+		QueryPerformanceFrequency(&freq);
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	return (double) now.QuadPart * 1e3 / freq.QuadPart;
+}